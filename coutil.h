@@ -7,8 +7,93 @@
 #include <type_traits>
 #include <variant>
 #include <iterator>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string_view>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <map>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <limits>
 #include <experimental/coroutine>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef COUTIL_PROFILE
+#include <map>
+#include <string>
+#include <sstream>
+#include <ostream>
+#if defined(__linux__)
+#include <signal.h>
+#include <time.h>
+#endif
+#endif
+
+#ifdef COUTIL_METRICS
+#include <ostream>
+#endif
+
+// the deadlock detector walks the coroutine registry kept for async backtraces
+#if defined(COUTIL_DEADLOCK) && !defined(COUTIL_BACKTRACE)
+#define COUTIL_BACKTRACE
+#endif
+
+#ifdef COUTIL_BACKTRACE
+#include <set>
+#include <string>
+#include <sstream>
+#include <ostream>
+#if defined(_MSC_VER)
+#define COUTIL_RETURN_ADDRESS() _ReturnAddress()
+#else
+#define COUTIL_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#define COUTIL_NOINLINE __declspec(noinline)
+#else
+#define COUTIL_NOINLINE __attribute__((noinline))
+#endif
+
+// await_suspend() members which record a suspension site are force-inlined under COUTIL_BACKTRACE, so the COUTIL_SITE() they take is an address inside the awaiting coroutine.
+// (msvc ignores __forceinline when inlining is disabled (/Ob0) - such builds report the await_suspend() of the awaitable instead)
+#ifdef COUTIL_BACKTRACE
+#if defined(_MSC_VER)
+#define COUTIL_SUSPEND_SITE __forceinline
+#else
+#define COUTIL_SUSPEND_SITE __attribute__((always_inline)) inline
+#endif
+#define COUTIL_SITE() ::coutil::detail::_here()
+#else
+#define COUTIL_SUSPEND_SITE
+#define COUTIL_SITE() nullptr
+#endif
+
+#ifdef COUTIL_TRACE
+#include <algorithm>
+#include <functional>
+#include <tuple>
+#include <queue>
+#include <map>
+#include <istream>
+#include <ostream>
+#endif
+
 namespace coutil
 {
 	// --------------------- //
@@ -20,479 +105,5547 @@ namespace coutil
 	// exception type that denotes accessing an empty couroutine management object.
 	struct bad_coroutine_access : std::runtime_error { using std::runtime_error::runtime_error; };
 
-	// ----------- //
+	// exception type that denotes awaiting an asynchronous operation which completed with a stopped (cancelled) signal.
+	struct operation_stopped : std::runtime_error { using std::runtime_error::runtime_error; };
 
-	// -- tasks -- //
+	// exception type that denotes awaiting a oneshot whose sender was destroyed without completing it.
+	struct broken_promise : std::runtime_error { using std::runtime_error::runtime_error; };
 
-	// ----------- //
+	// ------------- //
 
-	template<typename, typename> class basic_task;
+	// -- metrics -- //
 
-	namespace detail
+	// ------------- //
+
+	// if COUTIL_METRICS is defined, coutil keeps runtime statistics in per-thread shards (plain relaxed stores by the owning thread, no shared cache lines).
+	// shards are only aggregated when the metrics are read (e.g. by metrics::write_openmetrics()), which never stops the threads updating them.
+
+	namespace metrics
 	{
-		template<typename T, typename InitialSuspend>
-		struct _basic_task_promise_type
+		// the statistics kept by coutil - every metric is the sum of the per-thread deltas applied to it
+		enum class metric : std::size_t
 		{
-			// this holds the state information about this coroutine (ret or exception)
-			std::variant<std::exception_ptr, T> stat;
+			resumes,          // counter - coroutine resumptions by coutil drivers
+			live_tasks,       // gauge - task coroutines which have not been destroyed
+			live_generators,  // gauge - generator coroutines which have not been destroyed
+			frames_allocated, // counter - coroutine frames allocated
+			frames_freed,     // counter - coroutine frames freed
+			frame_bytes,      // gauge - bytes held by live coroutine frames
+			pool_scheduled,   // counter - coroutines scheduled on thread pools
+			pool_queued,      // gauge - coroutines waiting in thread pool run queues
+			blocking_queued,  // gauge - jobs waiting in blocking pool queues
+			blocking_jobs,    // counter - jobs run by blocking pools
 
-			auto get_return_object() { return basic_task<T, InitialSuspend>{ std::experimental::coroutine_handle<_basic_task_promise_type>::from_promise(*this) }; }
+			count
+		};
 
-			auto initial_suspend() const noexcept { return InitialSuspend{}; }
-			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+		// the primitives a coroutine can park on - parks and the time spent parked are kept per primitive
+		enum class primitive : std::size_t
+		{
+			async_mutex,        // acquiring an async_mutex
+			condition_variable, // waiting on an async_condition_variable (until the mutex is held again)
+			oneshot,            // awaiting a oneshot receiver
+			watch,              // awaiting a change of a watch
+			sender,             // awaiting a sender
+			offload,            // awaiting a job offloaded to a blocking_pool
+			timer,              // sleeping until a deadline
+			generator,          // waiting for a parked generator (next_until(), merge_ready())
+			worker_group,       // an idle worker waiting for a job
+			frame_budget,       // waiting for admission into a frame_budget
+			parallel,           // awaiting a parallel algorithm
 
-			template<typename U>
-			void return_value(U &&u) { stat.emplace<1>(std::forward<U>(u)); }
+			count
+		};
+	}
 
-			void unhandled_exception() { stat.emplace<0>(std::current_exception()); }
+	namespace detail
+	{
+#ifdef COUTIL_METRICS
+		// the per-thread metric values - written only by its thread, read by aggregation
+		struct _metric_shard
+		{
+			std::atomic<std::int64_t> values[(std::size_t)metrics::metric::count] = {};
+			std::atomic<std::int64_t> parks[(std::size_t)metrics::primitive::count] = {};        // completed parks per primitive
+			std::atomic<std::int64_t> park_wait_ns[(std::size_t)metrics::primitive::count] = {}; // total time spent parked per primitive, in nanoseconds
+			_metric_shard            *next = nullptr;
 		};
-		template<typename T, typename InitialSuspend>
-		struct _basic_task_promise_type<T&, InitialSuspend>
+
+		// registry of the shards of all live threads - the values of exited threads are folded into retired
+		struct _metric_registry
 		{
-			// this holds the state information about this coroutine (ret or exception)
-			std::variant<std::exception_ptr, T*> stat;
+			std::mutex     mutex;
+			_metric_shard *head = nullptr;
+			std::int64_t   retired[(std::size_t)metrics::metric::count] = {};
+			std::int64_t   retired_parks[(std::size_t)metrics::primitive::count] = {};
+			std::int64_t   retired_park_wait_ns[(std::size_t)metrics::primitive::count] = {};
 
-			auto get_return_object() { return basic_task<T&, InitialSuspend>{ std::experimental::coroutine_handle<_basic_task_promise_type>::from_promise(*this) }; }
+			static _metric_registry &get() { static _metric_registry reg; return reg; }
+		};
 
-			auto initial_suspend() const noexcept { return InitialSuspend{}; }
-			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+		// gets the calling thread's shard (registering it on first use)
+		inline _metric_shard &_this_metric_shard()
+		{
+			thread_local struct _registration
+			{
+				_metric_shard shard;
 
-			void return_value(T &p) { stat.emplace<1>(&p); }
+				_registration()
+				{
+					_metric_registry &reg = _metric_registry::get();
+					std::lock_guard<std::mutex> lock(reg.mutex);
+					shard.next = reg.head;
+					reg.head = &shard;
+				}
+				~_registration()
+				{
+					_metric_registry &reg = _metric_registry::get();
+					std::lock_guard<std::mutex> lock(reg.mutex);
+					for (_metric_shard **p = &reg.head; *p; p = &(*p)->next) if (*p == &shard) { *p = shard.next; break; }
+					for (std::size_t i = 0; i < (std::size_t)metrics::metric::count; ++i) reg.retired[i] += shard.values[i].load(std::memory_order_relaxed);
+					for (std::size_t i = 0; i < (std::size_t)metrics::primitive::count; ++i)
+					{
+						reg.retired_parks[i] += shard.parks[i].load(std::memory_order_relaxed);
+						reg.retired_park_wait_ns[i] += shard.park_wait_ns[i].load(std::memory_order_relaxed);
+					}
+				}
+			} registration;
+			return registration.shard;
+		}
+#endif
 
-			void unhandled_exception() { stat.emplace<0>(std::current_exception()); }
-		};
-		template<typename T, typename InitialSuspend>
-		struct _basic_task_promise_type<T&&, InitialSuspend>
+		// adds delta to a metric (does nothing unless COUTIL_METRICS is defined)
+		inline void _metric_add([[maybe_unused]] metrics::metric m, [[maybe_unused]] std::int64_t delta = 1)
 		{
-			// this holds the state information about this coroutine (ret or exception)
-			std::variant<std::exception_ptr, T*> stat;
-
-			auto get_return_object() { return basic_task<T&, InitialSuspend>{ std::experimental::coroutine_handle<_basic_task_promise_type>::from_promise(*this) }; }
+#ifdef COUTIL_METRICS
+			std::atomic<std::int64_t> &v = _this_metric_shard().values[(std::size_t)m];
+			v.store(v.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed); // single writer - no read-modify-write needed
+#endif
+		}
+#ifdef COUTIL_METRICS
+		// records a completed park on primitive p which lasted wait_ns nanoseconds
+		inline void _metric_park(metrics::primitive p, std::int64_t wait_ns)
+		{
+			_metric_shard &shard = _this_metric_shard();
+			std::atomic<std::int64_t> &n = shard.parks[(std::size_t)p], &ns = shard.park_wait_ns[(std::size_t)p];
+			n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			ns.store(ns.load(std::memory_order_relaxed) + wait_ns, std::memory_order_relaxed);
+		}
+#endif
 
-			auto initial_suspend() const noexcept { return InitialSuspend{}; }
-			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+		// empty base of promise types which counts live coroutines of a kind in the given gauge (if COUTIL_METRICS is defined)
+		template<metrics::metric M>
+		struct _live_metric
+		{
+#ifdef COUTIL_METRICS
+			_live_metric() { _metric_add(M, 1); }
+			_live_metric(const _live_metric&) { _metric_add(M, 1); }
+			~_live_metric() { _metric_add(M, -1); }
+#endif
+		};
+	}
 
-			void return_value(T &&p) { stat.emplace<1>(&p); }
+#ifdef COUTIL_METRICS
+	namespace metrics
+	{
+		// reads the current (aggregated) value of a metric
+		inline std::int64_t read(metric m)
+		{
+			detail::_metric_registry &reg = detail::_metric_registry::get();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			std::int64_t sum = reg.retired[(std::size_t)m];
+			for (detail::_metric_shard *s = reg.head; s; s = s->next) sum += s->values[(std::size_t)m].load(std::memory_order_relaxed);
+			return sum;
+		}
 
-			void unhandled_exception() { stat.emplace<0>(std::current_exception()); }
+		// the completed parks on one primitive and the total time they lasted
+		struct park_totals
+		{
+			std::int64_t parks = 0;
+			std::int64_t wait_ns = 0;
 		};
-		template<typename InitialSuspend>
-		struct _basic_task_promise_type<void, InitialSuspend>
+
+		// reads the current (aggregated) park totals of a primitive
+		inline park_totals read(primitive p)
 		{
-			// the exception thrown during coroutine execution (if any)
-			std::exception_ptr ex;
+			detail::_metric_registry &reg = detail::_metric_registry::get();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			park_totals sum{ reg.retired_parks[(std::size_t)p], reg.retired_park_wait_ns[(std::size_t)p] };
+			for (detail::_metric_shard *s = reg.head; s; s = s->next)
+			{
+				sum.parks += s->parks[(std::size_t)p].load(std::memory_order_relaxed);
+				sum.wait_ns += s->park_wait_ns[(std::size_t)p].load(std::memory_order_relaxed);
+			}
+			return sum;
+		}
 
-			auto get_return_object() { return basic_task<void, InitialSuspend>{ std::experimental::coroutine_handle<_basic_task_promise_type>::from_promise(*this) }; }
+		// writes all metrics to os in the OpenMetrics text format (terminated by # EOF)
+		inline void write_openmetrics(std::ostream &os)
+		{
+			struct info { metric m; const char *name, *type, *help; };
+			static constexpr info infos[] =
+			{
+				{ metric::resumes, "coutil_resumes", "counter", "Coroutine resumptions by coutil drivers." },
+				{ metric::live_tasks, "coutil_live_tasks", "gauge", "Task coroutines which have not been destroyed." },
+				{ metric::live_generators, "coutil_live_generators", "gauge", "Generator coroutines which have not been destroyed." },
+				{ metric::frames_allocated, "coutil_frames_allocated", "counter", "Coroutine frames allocated." },
+				{ metric::frames_freed, "coutil_frames_freed", "counter", "Coroutine frames freed." },
+				{ metric::frame_bytes, "coutil_frame_bytes", "gauge", "Bytes held by live coroutine frames." },
+				{ metric::pool_scheduled, "coutil_pool_scheduled", "counter", "Coroutines scheduled on thread pools." },
+				{ metric::pool_queued, "coutil_pool_queued", "gauge", "Coroutines waiting in thread pool run queues." },
+				{ metric::blocking_queued, "coutil_blocking_queued", "gauge", "Jobs waiting in blocking pool queues." },
+				{ metric::blocking_jobs, "coutil_blocking_jobs", "counter", "Jobs run by blocking pools." },
+			};
 
-			auto initial_suspend() const noexcept { return InitialSuspend{}; }
-			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+			std::int64_t values[(std::size_t)metric::count];
+			for (std::size_t i = 0; i < (std::size_t)metric::count; ++i) values[i] = read((metric)i);
 
-			void return_void() {}
+			for (const info &i : infos)
+			{
+				bool counter = i.type[0] == 'c';
+				os << "# TYPE " << i.name << ' ' << i.type << '\n' << "# HELP " << i.name << ' ' << i.help << '\n';
+				os << i.name << (counter ? "_total " : " ") << values[(std::size_t)i.m] << '\n';
+			}
 
-			void unhandled_exception() { ex = std::current_exception(); }
-		};
+			static constexpr const char *primitives[] = { "async_mutex", "condition_variable", "oneshot", "watch", "sender", "offload", "timer", "generator", "worker_group", "frame_budget", "parallel" };
+			static_assert(std::size(primitives) == (std::size_t)primitive::count, "every primitive needs a label");
+
+			os << "# TYPE coutil_park_wait_seconds summary\n" << "# HELP coutil_park_wait_seconds Time coroutines spent parked, by the primitive they waited on.\n";
+			for (std::size_t i = 0; i < (std::size_t)primitive::count; ++i)
+			{
+				park_totals t = read((primitive)i);
+				os << "coutil_park_wait_seconds_sum{primitive=\"" << primitives[i] << "\"} " << t.wait_ns / 1e9 << '\n';
+				os << "coutil_park_wait_seconds_count{primitive=\"" << primitives[i] << "\"} " << t.parks << '\n';
+			}
+			os << "# EOF\n";
+		}
 	}
+#endif
 
-	// basic_task represents a coroutine that co_returns a (single) value of type T.
-	// if an exception is thrown, it is caught and rethrown upon awaiting the result.
-	// if T is void, this represents a void-returning coroutine.
-	// if T is a reference type, represents a reference-returning coroutine (the reference category is preserved).
-	//     in this case the return value is stored as a pointer - it is the responsibility of the coroutine writer to guarantee the object outlives the coroutine.
-	// otherwise this represents a (regular) T-returning coroutine.
-	// T              - the return type of the coroutine (must not be cv-qualified).
-	// InitialSuspend - the type to return for initial_suspend() (empty brace initialized) (must not be cv-qualified).
-	template<typename T, typename InitialSuspend>
-	class basic_task
+	// ------------- //
+
+	// -- parking -- //
+
+	// ------------- //
+
+#ifdef COUTIL_FRAME_BUDGET
+	class frame_budget;
+#endif
+
+	namespace detail
 	{
-	public: // -- promise -- //
+		struct _park_state;
+#ifdef COUTIL_DEADLOCK
+		struct _wait_resource;
+#endif
 
-		static_assert(std::is_same_v<T, std::remove_cv_t<T>>, "T must not be cv-qualified");
-		static_assert(std::is_same_v<InitialSuspend, std::remove_cv_t<InitialSuspend>>, "InitialSuspend must not be cv-qualified");
+#ifdef COUTIL_FRAME_BUDGET
+		// the budget charged for the coroutine frames allocated by the calling thread (see frame_budget) - set while spawning into a budget and while running a budgeted coroutine
+		inline frame_budget *&_current_budget() { thread_local frame_budget *budget = nullptr; return budget; }
 
-		typedef detail::_basic_task_promise_type<T, InitialSuspend> promise_type;
-		friend struct promise_type;
+		void _charge_frame(frame_budget &budget, std::size_t size);
+		void _free_frame(frame_budget &budget, std::size_t size);
 
-	private: // -- private utility info -- //
+		// makes budget the calling thread's current budget for the lifetime of the scope
+		class _budget_scope
+		{
+		private: // -- data -- //
 
-		typedef std::experimental::coroutine_handle<promise_type> handle;
+			frame_budget *prev;
 
-		// constexpr control flags for performing compile-time branching in management functions
-		static inline constexpr bool void_mode = std::is_void_v<T>;
-		static inline constexpr bool ref_mode = std::is_reference_v<T>;
+		public: // -- ctor / dtor / asgn -- //
 
-	private: // -- data -- //
+			explicit _budget_scope(frame_budget *budget) : prev(std::exchange(_current_budget(), budget)) {}
+			~_budget_scope() { _current_budget() = prev; }
 
-		handle co = nullptr; // the raw coroutine handle
+			_budget_scope(const _budget_scope&) = delete;
+			_budget_scope &operator=(const _budget_scope&) = delete;
+		};
+#endif
 
-	private: // -- private util -- //
+		// wake link which can be attached to a parked coroutine by its driver - unparking the coroutine just calls notify (which then becomes responsible for releasing it).
+		// this lets a driver of several coroutines (e.g. merge_ready()) find out which ones became runnable without polling them.
+		struct _wake_link
+		{
+			void (*notify)(_wake_link &link, _park_state &state) = nullptr;
+		};
 
-		explicit basic_task(handle h) : co(std::move(h)) {}
+		// lets an awaitable check whether the event its (parked) coroutine was woken for really completed before the coroutine is resumed (see basic_generator::iterator::next_until()).
+		// _resume() calls pass() in place of resuming - it returns true to go ahead with the resume, or false if it parked the coroutine again.
+		struct _resume_gate
+		{
+			bool (*pass)(_resume_gate &gate) = nullptr;
+		};
 
-	public: // -- ctor / dtor / asgn -- //
+		// intrusive run queue hook used by executors which take ownership of a coroutine (see thread_pool)
+		struct _schedule_hook
+		{
+			_park_state                          *next = nullptr;   // the next coroutine in the run queue
+			std::experimental::coroutine_handle<> self;             // the coroutine this hook belongs to
+			void                                (*finish)(std::experimental::coroutine_handle<>) = nullptr; // extracts the result of the (completed) coroutine, rethrowing any exception, and destroys it
+			std::atomic<int>                      handoff{ 0 };     // a parked coroutine is driven on (e.g. rescheduled) by whichever of its driver and its unparker comes second
+#ifdef COUTIL_TRACE
+			std::uint64_t                         trace_id = 0;     // the id of the coroutine in the lifecycle trace
+#endif
+		};
 
-		// constructs an empty basic_task (does not refer to any existing coroutine)
-		basic_task() = default;
+		// parking state shared by all coutil promise types.
+		// a coroutine is parked while it is suspended waiting on some external event (e.g. a sender completing on another thread).
+		// drivers (resume(), wait(), iterator advancement) will not resume a parked coroutine - the event source unparks it upon completion.
+		struct _park_state
+		{
+			std::atomic<std::uintptr_t> parked{ 0 };         // bit 0 is set while parked - the other bits hold whoever waits for the unpark (if any): a _parker (see _parker::watch()) or, with bit 1 set, a _thread_waiter
+			_wake_link                 *link = nullptr;     // the wake link to notify on unpark (if any)
+			_schedule_hook              hook;               // run queue hook for executors
+			_resume_gate               *gate = nullptr;     // if set, consulted by _resume() before resuming
+			const char                 *category = nullptr; // optional static label for diagnostics (e.g. profiler samples)
 
-		// destroys the currently-held coroutine handle (if any)
-		~basic_task() { if (co) co.destroy(); }
+#ifdef COUTIL_BACKTRACE
+			std::atomic<_park_state*>         awaiter{ nullptr }; // the coroutine awaiting this one (if any)
+			std::atomic<const void*>          site{ nullptr };    // return address of the last suspension point
+			mutable std::atomic<const void*>  frame{ nullptr };   // the coroutine frame (recorded on resume)
+			mutable std::atomic<bool>         running{ false };   // true while being resumed
+			_park_state                      *bt_prev = nullptr, *bt_next = nullptr; // links in the coroutine registry
 
-		basic_task(const basic_task&) = delete;
-		basic_task &operator=(const basic_task&) = delete;
+			_park_state();
+			~_park_state();
+#endif
+#ifdef COUTIL_DEADLOCK
+			mutable std::atomic<const _wait_resource*> blocked_on{ nullptr }; // the primitive this coroutine is queued on (if any)
+#endif
+#ifdef COUTIL_FRAME_BUDGET
+			frame_budget *budget = _current_budget(); // the budget charged for frames this coroutine creates (its own frame is charged by operator new)
 
-		// steals the handle of other - other is left in the empty state
-		basic_task(basic_task &&other) : co(std::exchange(other.co, nullptr)) {}
-		// discards the current coroutine handle and steals other's - other is left in the empty state.
-		// on self assignment, does nothing.
-		basic_task &operator=(basic_task &&other) { co = std::exchange(other.co, nullptr); return *this; }
+			// each frame is prefixed by the budget it was charged to (if any), so it can be credited when freed
+			static inline constexpr std::size_t frame_header = alignof(std::max_align_t);
+#endif
 
-	public: // -- state information -- //
+			bool is_parked() const { return parked.load(std::memory_order_acquire) != 0; }
 
-		// returns true if the basic_task is currently in the empty state.
-		bool empty() const { return !co; }
+#if defined(COUTIL_METRICS) || defined(COUTIL_FRAME_BUDGET)
+			// coroutine frames of all coutil promise types are allocated through these (found by lookup in the promise type).
+			// operator new is kept out of line so the coroutine frame code sees a matched member new/delete pair rather than a global new released by the member delete.
+			COUTIL_NOINLINE static void *operator new(std::size_t size)
+			{
+				_metric_add(metrics::metric::frames_allocated);
+				_metric_add(metrics::metric::frame_bytes, (std::int64_t)size);
+#ifdef COUTIL_FRAME_BUDGET
+				frame_budget *b = _current_budget();
+				char *p = static_cast<char*>(::operator new(size + frame_header));
+				*reinterpret_cast<frame_budget**>(p) = b;
+				if (b) _charge_frame(*b, size);
+				return p + frame_header;
+#else
+				return ::operator new(size);
+#endif
+			}
+			static void operator delete(void *p, std::size_t size)
+			{
+				_metric_add(metrics::metric::frames_freed);
+				_metric_add(metrics::metric::frame_bytes, -(std::int64_t)size);
+#ifdef COUTIL_FRAME_BUDGET
+				char *raw = static_cast<char*>(p) - frame_header;
+				frame_budget *b = *reinterpret_cast<frame_budget**>(raw);
+				::operator delete(raw, size + frame_header);
+				if (b) _free_frame(*b, size);
+#else
+				::operator delete(p, size);
+#endif
+			}
+#endif
+		};
 
-		// returns true if the basic_task is non-empty
-		explicit operator bool() const { return !empty(); }
-		// returns true if the basic_task is empty
-		bool operator!() const { return empty(); }
+#ifdef COUTIL_BACKTRACE
+		// registry of all live coutil coroutines (see dump_suspended())
+		struct _coroutine_registry
+		{
+			std::mutex   mutex;
+			_park_state *head = nullptr;
 
-	public: // -- coroutine control -- //
+			static _coroutine_registry &get() { static _coroutine_registry reg; return reg; }
+		};
 
-		// returns true if the coroutine has completed execution (successfully or due to exception).
-		// if the basic_task is currently empty, throws bad_coroutine_access.
-		bool done() const
+		inline _park_state::_park_state()
 		{
-			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
-			return co.done();
+			_coroutine_registry &reg = _coroutine_registry::get();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			if ((bt_next = reg.head)) bt_next->bt_prev = this;
+			reg.head = this;
 		}
-
-		// if the coroutine is not finished, resumes it, otherwise does nothing.
-		// if the basic_task is currently empty, throws bad_coroutine_access.
-		void resume()
+		inline _park_state::~_park_state()
 		{
-			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
-			if (!co.done()) co.resume();
+			_coroutine_registry &reg = _coroutine_registry::get();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			(bt_prev ? bt_prev->bt_next : reg.head) = bt_next;
+			if (bt_next) bt_next->bt_prev = bt_prev;
 		}
 
-		// blocks until completion of the coroutine and gets the returned value.
-		// if the basic_task is currently empty, throws bad_coroutine_access.
-		// if the coroutine ended due to exception, rethrows the exception.
-		// after this operation (regardless of success) the basic_task is in the empty state (the coroutine is destroyed).
-		// T is void      - returns void.
-		// T is reference - returns the reference (preserving reference category).
-		// otherwise      - returns the stored object by value (move-constructed).
-		decltype(auto) wait()
+		// returns an address inside the code which called it (used through COUTIL_SITE())
+		COUTIL_NOINLINE inline const void *_here() { return COUTIL_RETURN_ADDRESS(); }
+
+		// records the suspension site of s - site is the COUTIL_SITE() taken by the (inlined) await_suspend() of the awaitable
+		inline void _note_site(_park_state &s, const void *site) { s.site.store(site, std::memory_order_relaxed); }
+#else
+		inline void _note_site(_park_state&, const void*) {}
+#endif
+
+#ifdef COUTIL_DEADLOCK
+		// wait-for record of a primitive which is held by one coroutine at a time (e.g. async_mutex) - coroutines queued on it wait for its owner (see find_deadlocks()).
+		// the owner and the blocked_on markers of the queued coroutines are only changed while holding guard, so the detector can read an edge consistently.
+		struct _wait_resource
 		{
-			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
-			while (!co.done()) co.resume();
+			const void                        *object; // the primitive
+			const char                        *kind;   // its type name for reports
+			std::mutex                        &guard;
+			std::atomic<const _park_state*>    owner{ nullptr }; // null if free or held outside of a coutil coroutine
 
-			// create a sentry object that will set us to the empty state regardless of success (i.e. even if an exception is thrown)
-			struct _
-			{
-				handle &h;
-				_(handle &_h) : h(_h) {}
-				~_() { h.destroy(); h = nullptr; }
-			} sentry(co);
-			
-			if constexpr (void_mode)
+			_wait_resource(const void *_object, const char *_kind, std::mutex &_guard) : object(_object), kind(_kind), guard(_guard) {}
+			// the detector reads resources while holding the registry mutex - acquiring it here waits for a running check to be done with this one
+			~_wait_resource() { std::lock_guard<std::mutex> lock(_coroutine_registry::get().mutex); }
+
+			_wait_resource(const _wait_resource&) = delete;
+			_wait_resource &operator=(const _wait_resource&) = delete;
+		};
+
+		// the innermost coutil coroutine the calling thread is currently running (null if none)
+		inline const _park_state *&_current_state() { thread_local const _park_state *state = nullptr; return state; }
+#endif
+
+		// records that the coroutine h suspended to await the coroutine with state awaited - returns the recorded awaiter (null if none, e.g. unless COUTIL_BACKTRACE is defined)
+		template<typename P>
+		_park_state *_note_await([[maybe_unused]] _park_state &awaited, [[maybe_unused]] std::experimental::coroutine_handle<P> h, [[maybe_unused]] const void *site)
+		{
+#ifdef COUTIL_BACKTRACE
+			if constexpr (std::is_base_of_v<_park_state, P>)
 			{
-				if (co.promise().ex) std::rethrow_exception(co.promise().ex);
+				awaited.awaiter.store(&h.promise(), std::memory_order_relaxed);
+				_note_site(h.promise(), site);
+				return &h.promise();
 			}
-			else if constexpr (ref_mode)
+#endif
+			return nullptr;
+		}
+		// records that the await of awaited by awaiter (as returned by _note_await()) is over, for coroutines which outlive an await (generators).
+		// the edge is only cleared if it still names awaiter - another coroutine may be awaiting awaited by now.
+		inline void _end_await([[maybe_unused]] _park_state &awaited, [[maybe_unused]] _park_state *awaiter)
+		{
+#ifdef COUTIL_BACKTRACE
+			if (awaiter) awaited.awaiter.compare_exchange_strong(awaiter, nullptr, std::memory_order_relaxed);
+#endif
+		}
+
+		// a thread blocked until a parked coroutine is unparked (see _block_while_parked()) - registered in the coroutine's parked word, so the unpark which releases the coroutine claims it.
+		// wake() signals under the mutex, so the waiter cannot return (and destroy this) before wake() is done with it.
+		struct _thread_waiter
+		{
+			std::mutex              mutex;
+			std::condition_variable cv;
+			bool                    woken = false;
+
+			void wake()
 			{
-				if (std::remove_reference_t<T> **p = std::get_if<1>(&co.promise().stat)) return static_cast<T>(**p); // cast is to preserve rvalue reference return type (otherwise would deduce to lvalue reference)
-				else std::rethrow_exception(std::get<0>(co.promise().stat));
+				std::lock_guard<std::mutex> lock(mutex);
+				woken = true;
+				cv.notify_one();
 			}
-			else
+			void wait()
 			{
-				if (T *ret = std::get_if<1>(&co.promise().stat)) return static_cast<T>(std::move(*ret)); // the cast is to return a move-constructed value
-				else std::rethrow_exception(std::get<0>(co.promise().stat));
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [this] { return woken; });
 			}
-		}
+		};
+		static_assert(alignof(_thread_waiter) >= 4, "the low two bits of a parked word are flags");
 
-	public: // -- await interface -- //
+		// parks an awaiting coroutine from within await_suspend() (pass COUTIL_SITE() as site) and unparks it once the awaited event completes.
+		// unpark() must be the last action the event source takes on the awaitable (the coroutine may be resumed and the awaitable destroyed immediately after).
+		class _parker
+		{
+		private: // -- data -- //
 
-		bool           await_ready() { return done(); }
-		void           await_suspend(std::experimental::coroutine_handle<>) {}
-		decltype(auto) await_resume() { return wait(); }
-	};
+			_park_state *state = nullptr;
+#ifdef COUTIL_METRICS
+			std::chrono::steady_clock::time_point parked_at;
+			metrics::primitive                    kind = metrics::primitive::count;
+#endif
 
-	// a task is a basic_task which starts immediately and suspends
-	template<typename T = void>
-	using task = basic_task<std::remove_cv_t<T>, std::experimental::suspend_never>;
+		public: // -- interface -- //
 
-	// a lazy_task is a basic_task which suspends immediately upon creation
-	template<typename T = void>
-	using lazy_task = basic_task<std::remove_cv_t<T>, std::experimental::suspend_always>;
+			// kind is the primitive the coroutine waits on (parks are timed per primitive)
+			template<typename P>
+			void park(std::experimental::coroutine_handle<P> h, const void *site, [[maybe_unused]] metrics::primitive kind)
+			{
+				static_assert(std::is_base_of_v<_park_state, P>, "only coutil coroutines can await this object");
+				state = &h.promise();
+				_note_site(*state, site);
+#ifdef COUTIL_METRICS
+				parked_at = std::chrono::steady_clock::now();
+				this->kind = kind;
+#endif
+				state->parked.store(1, std::memory_order_relaxed);
+			}
+			void unpark()
+			{
+#ifdef COUTIL_METRICS
+				_metric_park(kind, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - parked_at).count());
+#endif
+				if (_wake_link *link = state->link) return link->notify(*link, *state);
 
-	namespace detail
-	{
-		// gets if type T is any kind of basic_task
+				// clearing the park also claims the waiting driver (if any) - after this, the coroutine may be resumed and destroyed at any time
+				std::uintptr_t prev = state->parked.exchange(0, std::memory_order_acq_rel);
+				if (std::uintptr_t w = prev & ~std::uintptr_t(3))
+				{
+					if (prev & 2) reinterpret_cast<_thread_waiter*>(w)->wake();
+					else reinterpret_cast<_parker*>(w)->unpark();
+				}
+			}
+
+			// parks the coroutine passed to park() again (from the coroutine's own thread), e.g. after a wake which did not complete the awaited event
+			void repark()
+			{
+#ifdef COUTIL_METRICS
+				parked_at = std::chrono::steady_clock::now();
+#endif
+				state->parked.store(1, std::memory_order_relaxed);
+			}
+			// takes back a park from within the coroutine before anything could unpark it (e.g. after withdrawing its registration) - the coroutine simply continues
+			void retract() { state->parked.store(0, std::memory_order_relaxed); }
+
+			// returns true if the coroutine is still parked
+			bool parked() const { return state->is_parked(); }
+			// gets the state of the coroutine passed to park() (null if it was never parked)
+			_park_state *parked_state() const { return state; }
+
+			// registers waiter to be unparked along with the parked coroutine s (see basic_generator::iterator::next_until()) - returns false if s is no longer parked.
+			// the registration shares a word with the park, so the unpark which releases s also claims the waiter - it never touches s after that.
+			static bool watch(_park_state &s, _parker &waiter)
+			{
+				std::uintptr_t expected = 1;
+				return s.parked.compare_exchange_strong(expected, 1 | reinterpret_cast<std::uintptr_t>(&waiter), std::memory_order_acq_rel, std::memory_order_acquire);
+			}
+			// takes back a registration made by watch() - returns false if an unpark already claimed it (the waiter is then about to be unparked)
+			static bool unwatch(_park_state &s, _parker &waiter)
+			{
+				std::uintptr_t expected = 1 | reinterpret_cast<std::uintptr_t>(&waiter);
+				return s.parked.compare_exchange_strong(expected, 1, std::memory_order_acq_rel, std::memory_order_acquire);
+			}
+		};
+
+		// blocks the calling thread until the coroutine s is no longer parked (returns right away if it is not) - used by the blocking drivers rather than spinning
+		inline void _block_while_parked(_park_state &s)
+		{
+			_thread_waiter w;
+			std::uintptr_t expected = 1;
+			if (s.parked.compare_exchange_strong(expected, 3 | reinterpret_cast<std::uintptr_t>(&w), std::memory_order_acq_rel, std::memory_order_acquire)) w.wait();
+		}
+
+		// holds the outcome of an asynchronous operation producing T - either a value or an exception.
+		// if T is a reference type, the result is stored as a pointer (the referenced object must outlive the result).
 		template<typename T>
-		struct _is_task : std::false_type {};
-		template<typename T, typename InitialSuspend>
-		struct _is_task<basic_task<T, InitialSuspend>> : std::true_type {};
+		class _async_result
+		{
+		private: // -- private utility info -- //
+
+			struct _void {}; // stand-in value for a void T
+
+			typedef std::conditional_t<std::is_void_v<T>, _void, std::conditional_t<std::is_reference_v<T>, std::remove_reference_t<T>*, T>> storage_t;
+
+		private: // -- data -- //
+
+			std::variant<std::monostate, storage_t, std::exception_ptr> stat; // monostate until a result is set
+
+		public: // -- interface -- //
+
+			// stores the result value - if this throws, the exception is stored instead
+			template<typename ...Args>
+			void set_value(Args &&...args) noexcept
+			{
+				try
+				{
+					if constexpr (std::is_reference_v<T>) stat.template emplace<1>(&args...);
+					else stat.template emplace<1>(std::forward<Args>(args)...);
+				}
+				catch (...) { set_exception(std::current_exception()); }
+			}
+			void set_exception(std::exception_ptr ex) noexcept { stat.template emplace<2>(std::move(ex)); }
+
+			// invokes f and stores its return value (or the exception it throws)
+			template<typename F>
+			void set_from(F &&f) noexcept
+			{
+				try
+				{
+					if constexpr (std::is_void_v<T>) { std::forward<F>(f)(); set_value(); }
+					else set_value(std::forward<F>(f)());
+				}
+				catch (...) { set_exception(std::current_exception()); }
+			}
+
+			// returns true if a result has been set
+			bool ready() const { return stat.index() != 0; }
+
+			// gets the result value (moved out) or rethrows the stored exception - a result must have been set
+			T get()
+			{
+				if (std::exception_ptr *ex = std::get_if<2>(&stat)) std::rethrow_exception(*ex);
+
+				if constexpr (std::is_void_v<T>) return;
+				else if constexpr (std::is_reference_v<T>) return static_cast<T>(*std::get<1>(stat)); // cast is to preserve reference category
+				else return std::move(std::get<1>(stat));
+			}
+		};
 	}
 
-	// gets if type T is any kind of (potentially cv-qualified) basic_task
-	template<typename T>
-	using is_task = detail::_is_task<std::remove_cv_t<T>>;
-	template<typename T>
-	inline constexpr bool is_task_v = is_task<T>::value;
-	
-	// given one or more tasks, resume()s them in a loop until all of them are done().
-	// wait() is not actually called on any task, so the results are not extracted.
-	template<typename ...T, std::enable_if_t<std::conjunction_v<is_task<T>...>, int> = 0>
-	void wait_all(T &...tasks)
+	// --------------- //
+
+	// -- profiling -- //
+
+	// --------------- //
+
+	// if COUTIL_PROFILE is defined, each thread keeps a slot holding the stack of coroutines it is currently running (maintained around every resume).
+	// this is what current_coroutine() and the sampling profiler read - otherwise the slot does not exist and resuming has no extra cost.
+
+	namespace detail
 	{
-		while ((... | (tasks.resume(), !tasks.done())));
+#ifdef COUTIL_PROFILE
+		// the per-thread stack of running coroutines - written only by its thread, but readable from a profiler thread (a seqlock over the stack)
+		struct _thread_slot
+		{
+			static inline constexpr std::size_t max_depth = 16; // deeper nesting is counted but not recorded
+
+			std::atomic<std::size_t> seq{ 0 };   // odd while the stack is being pushed or popped
+			std::atomic<std::size_t> depth{ 0 };
+			std::atomic<const void*> frames[max_depth] = {};
+			std::atomic<const char*> categories[max_depth] = {};
+
+			std::size_t   index = 0;       // the order in which the thread first resumed a coroutine
+			_thread_slot *next = nullptr;  // the next slot in the registry
+		};
+
+		// registry of the slots of all live threads - the mutex is held by the profiler while sampling
+		struct _slot_registry
+		{
+			std::mutex    mutex;
+			_thread_slot *head = nullptr;
+			std::size_t   count = 0;
+
+			static _slot_registry &get() { static _slot_registry reg; return reg; }
+		};
+
+#if defined(__linux__)
+		// the calling thread's slot (null until it is registered) for the profiler's signal handler - a trivially initialized thread_local, so reading it never runs the registration
+		inline _thread_slot *&_signal_thread_slot() { thread_local _thread_slot *slot = nullptr; return slot; }
+#endif
+
+		// gets the calling thread's slot (registering it on first use)
+		inline _thread_slot &_this_thread_slot()
+		{
+			thread_local struct _registration
+			{
+				_thread_slot slot;
+
+				_registration()
+				{
+					_slot_registry &reg = _slot_registry::get();
+					std::lock_guard<std::mutex> lock(reg.mutex);
+					slot.index = reg.count++;
+					slot.next = reg.head;
+					reg.head = &slot;
+#if defined(__linux__)
+					_signal_thread_slot() = &slot;
+#endif
+				}
+				~_registration()
+				{
+#if defined(__linux__)
+					_signal_thread_slot() = nullptr;
+#endif
+					_slot_registry &reg = _slot_registry::get();
+					std::lock_guard<std::mutex> lock(reg.mutex);
+					for (_thread_slot **p = &reg.head; *p; p = &(*p)->next) if (*p == &slot) { *p = slot.next; break; }
+				}
+			} registration;
+			return registration.slot;
+		}
+
+		// pushes a coroutine onto the calling thread's slot for the duration of a resume
+		class _resume_scope
+		{
+		private: // -- data -- //
+
+			_thread_slot &slot;
+			std::size_t   d;
+
+		private: // -- private util -- //
+
+			// marks the stack as being written (fencing off readers) - returns the (even) sequence number it had before
+			std::size_t _begin_write()
+			{
+				std::size_t s = slot.seq.load(std::memory_order_relaxed);
+				slot.seq.store(s + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				return s;
+			}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			_resume_scope(const void *address, const char *category) : slot(_this_thread_slot()), d(slot.depth.load(std::memory_order_relaxed))
+			{
+				std::size_t s = _begin_write();
+				if (d < _thread_slot::max_depth)
+				{
+					slot.frames[d].store(address, std::memory_order_relaxed);
+					slot.categories[d].store(category, std::memory_order_relaxed);
+				}
+				slot.depth.store(d + 1, std::memory_order_relaxed);
+				slot.seq.store(s + 2, std::memory_order_release);
+			}
+			~_resume_scope()
+			{
+				std::size_t s = _begin_write();
+				slot.depth.store(d, std::memory_order_relaxed);
+				slot.seq.store(s + 2, std::memory_order_release);
+			}
+
+			_resume_scope(const _resume_scope&) = delete;
+			_resume_scope &operator=(const _resume_scope&) = delete;
+		};
+#endif
+
+#ifdef COUTIL_RCU
+		// a thread's registered rcu marker (see rcu_cell) - 0 while the thread holds no snapshots, otherwise the rcu epoch at which it started reading
+		struct _rcu_thread
+		{
+			std::atomic<std::uint64_t> epoch{ 0 };
+			_rcu_thread               *next = nullptr;
+		};
+
+		// the calling thread's rcu reading state - trivially initialized, so resuming a coroutine only costs a counter update unless the thread has read a snapshot
+		struct _rcu_local
+		{
+			std::size_t  depth;        // the number of coutil resumes the thread is currently inside
+			std::size_t  online_depth; // the depth of the first read since the thread's last quiescent point
+			bool         online;       // true if the thread has read a snapshot since its last quiescent point
+			_rcu_thread *record;       // the thread's registered marker (null until its first read)
+		};
+		inline _rcu_local &_this_rcu_local() { thread_local _rcu_local local{}; return local; }
+
+		// marks a quiescent point for the calling thread - it no longer holds any snapshots
+		inline void _rcu_quiescent(_rcu_local &local)
+		{
+			local.online = false;
+			local.record->epoch.store(0, std::memory_order_release);
+		}
+
+		// tracks the resume depth of the calling thread - leaving a resume below the depth of the thread's first read is a quiescent point
+		class _rcu_resume_scope
+		{
+		private: // -- data -- //
+
+			_rcu_local &local;
+
+		public: // -- ctor / dtor / asgn -- //
+
+			_rcu_resume_scope() : local(_this_rcu_local()) { ++local.depth; }
+			~_rcu_resume_scope() { if (--local.depth < local.online_depth && local.online) _rcu_quiescent(local); }
+
+			_rcu_resume_scope(const _rcu_resume_scope&) = delete;
+			_rcu_resume_scope &operator=(const _rcu_resume_scope&) = delete;
+		};
+#endif
+
+		// resumes a (suspended) coutil coroutine given its parking state - all coutil drivers resume coroutines through this
+		inline void _resume(std::experimental::coroutine_handle<> h, [[maybe_unused]] const _park_state &state)
+		{
+#ifdef COUTIL_RCU
+			_rcu_resume_scope rcu_scope;
+#endif
+#ifdef COUTIL_FRAME_BUDGET
+			_budget_scope budget_scope(state.budget);
+#endif
+#ifdef COUTIL_PROFILE
+			_resume_scope scope(h.address(), state.category);
+#endif
+			_metric_add(metrics::metric::resumes);
+#ifdef COUTIL_BACKTRACE
+			state.frame.store(h.address(), std::memory_order_relaxed);
+			bool outer = !state.running.exchange(true, std::memory_order_relaxed);
+			struct _clear { const _park_state &s; bool outer; ~_clear() { if (outer) s.running.store(false, std::memory_order_relaxed); } } clear{ state, outer };
+#endif
+#ifdef COUTIL_DEADLOCK
+			struct _restore { const _park_state *prev; ~_restore() { _current_state() = prev; } } restore{ std::exchange(_current_state(), &state) };
+#endif
+			if (!state.gate || state.gate->pass(*state.gate)) h.resume();
+		}
+		template<typename P>
+		void _resume(std::experimental::coroutine_handle<P> h) { _resume(h, h.promise()); }
 	}
-	// given one or more tasks, resume()s them in a loop until at least one of them is done().
-	// wait() is not actually called on any task, so the results are not extracted.
-	template<typename ...T, std::enable_if_t<std::conjunction_v<is_task<T>...>, int> = 0>
-	void wait_any(T &...tasks)
+
+#ifdef COUTIL_PROFILE
+	// returns the address of the innermost coroutine the calling thread is currently running, or null if there is none
+	inline const void *current_coroutine()
 	{
-		while (!(... | (tasks.resume(), tasks.done())));
+		detail::_thread_slot &slot = detail::_this_thread_slot();
+		std::size_t d = slot.depth.load(std::memory_order_relaxed);
+		return d == 0 ? nullptr : d <= detail::_thread_slot::max_depth ? slot.frames[d - 1].load(std::memory_order_relaxed) : nullptr;
+	}
+#endif
+
+	// ---------------------- //
+
+	// -- async backtraces -- //
+
+	// ---------------------- //
+
+	// if COUTIL_BACKTRACE is defined, every coutil coroutine records the coroutine awaiting it and the return address of its last suspension point.
+	// this lets a stalled chain of co_awaits be reconstructed (innermost first) even though the native stack only shows the driver.
+	// the site is taken by the force-inlined await_suspend() of the awaitable, so it points at the co_await in the awaiting coroutine rather than into coutil.
+	// cost: every coutil coroutine frame links itself into a global registry, taking one process-wide mutex on construction and destruction -
+	// programs creating many short-lived coroutines on many threads will contend on it, which is why this is opt-in and meant for diagnostic builds.
+
+#ifdef COUTIL_BACKTRACE
+	// one coroutine in an async backtrace
+	struct async_frame
+	{
+		const void *frame = nullptr;    // the coroutine frame address (null if it has never been resumed)
+		const char *category = nullptr; // its category (see set_category())
+		const void *site = nullptr;     // the return address of its last suspension point (null if it never suspended)
+		bool        parked = false;     // true if parked waiting on an external event
+		bool        running = false;    // true if currently being resumed (e.g. blocked in a nested wait)
+	};
+
+	// converts a code address into readable text - install a platform symbolizer (e.g. based on DbgHelp or dladdr) with set_async_symbolizer()
+	typedef std::string (*async_symbolizer)(const void *address);
+
+	namespace detail
+	{
+		inline std::string _default_symbolize(const void *address) { std::ostringstream ss; ss << address; return ss.str(); }
+		inline std::atomic<async_symbolizer> &_symbolizer() { static std::atomic<async_symbolizer> fn{ &_default_symbolize }; return fn; }
+
+		// walks the awaiter chain from s - the registry mutex must be held (only coroutines in live are followed)
+		inline std::vector<async_frame> _walk(const _park_state *s, const std::set<const _park_state*> &live)
+		{
+			std::vector<async_frame> bt;
+			for (; s && live.count(s) && bt.size() <= live.size(); s = s->awaiter.load(std::memory_order_relaxed))
+				bt.push_back({ s->frame.load(std::memory_order_relaxed), s->category, s->site.load(std::memory_order_relaxed), s->is_parked(), s->running.load(std::memory_order_relaxed) });
+			return bt;
+		}
+		inline std::set<const _park_state*> _live_coroutines()
+		{
+			std::set<const _park_state*> live;
+			for (const _park_state *s = _coroutine_registry::get().head; s; s = s->bt_next) live.insert(s);
+			return live;
+		}
+	}
+
+	// sets the symbolizer used when writing backtraces (null restores the default, which prints raw addresses)
+	inline void set_async_symbolizer(async_symbolizer fn) { detail::_symbolizer().store(fn ? fn : &detail::_default_symbolize); }
+
+	// returns the async backtrace of the coroutine with the given frame address (e.g. from current_coroutine()) - that coroutine, then the one awaiting it, and so on.
+	// if no live coutil coroutine with that frame has been resumed, returns an empty backtrace.
+	inline std::vector<async_frame> async_backtrace(const void *frame)
+	{
+		detail::_coroutine_registry &reg = detail::_coroutine_registry::get();
+		std::lock_guard<std::mutex> lock(reg.mutex);
+		for (const detail::_park_state *s = reg.head; s; s = s->bt_next)
+			if (frame && s->frame.load(std::memory_order_relaxed) == frame) return detail::_walk(s, detail::_live_coroutines());
+		return {};
+	}
+	// returns the async backtrace of a (live) coutil coroutine
+	template<typename P>
+	std::vector<async_frame> async_backtrace(std::experimental::coroutine_handle<P> h)
+	{
+		static_assert(std::is_base_of_v<detail::_park_state, P>, "only coutil coroutines have async backtraces");
+		h.promise().frame.store(h.address(), std::memory_order_relaxed);
+		return async_backtrace(h.address());
+	}
+
+	// writes a backtrace to os - one symbolized frame per line
+	inline void write_async_backtrace(std::ostream &os, const std::vector<async_frame> &bt)
+	{
+		async_symbolizer symbolize = detail::_symbolizer().load();
+		for (std::size_t i = 0; i < bt.size(); ++i)
+		{
+			const async_frame &f = bt[i];
+			os << '#' << i << ' ' << (f.category ? f.category : "coroutine") << '@' << f.frame << (f.running ? " running" : f.parked ? " parked" : " suspended");
+			if (f.site) os << " at " << symbolize(f.site);
+			os << '\n';
+		}
+	}
+
+	// writes the async backtrace of every chain of live coutil coroutines (starting from each one which is not itself awaiting another) to os, separated by blank lines.
+	// coroutines which were never started are skipped (completed ones are listed until destroyed).
+	inline void dump_suspended(std::ostream &os)
+	{
+		std::vector<std::vector<async_frame>> chains;
+		{
+			detail::_coroutine_registry &reg = detail::_coroutine_registry::get();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			std::set<const detail::_park_state*> live = detail::_live_coroutines(), awaited;
+			for (const detail::_park_state *s : live) awaited.insert(s->awaiter.load(std::memory_order_relaxed));
+			for (const detail::_park_state *s = reg.head; s; s = s->bt_next)
+			{
+				if (!s->frame.load(std::memory_order_relaxed) || awaited.count(s)) continue;
+				chains.push_back(detail::_walk(s, live));
+			}
+		}
+		for (std::size_t i = 0; i < chains.size(); ++i)
+		{
+			if (i) os << '\n';
+			write_async_backtrace(os, chains[i]);
+		}
 	}
+#endif
+
+	// ------------- //
+
+	// -- tracing -- //
+
+	// ------------- //
+
+	// if COUTIL_TRACE is defined, thread_pool records the lifecycle of the coroutines it owns (spawn, each run with its duration and how it suspended, wakeups) into a global trace.
+	// the trace can be saved in a compact binary form and replayed offline against other scheduling policies with simulate().
+
+#ifdef COUTIL_TRACE
+	namespace trace
+	{
+		enum class event_kind : std::uint8_t { spawn, run, wake };
+
+		// how a run ended (the suspension reason)
+		enum class run_outcome : std::uint8_t { done, parked, yielded };
+
+		// wakeup sources
+		enum class wake_source : std::uint8_t { external, worker };
+
+		// a single lifecycle event (see write() for its binary form)
+		struct event
+		{
+			std::uint64_t time = 0;     // nanoseconds since the recorder was (re)started - for runs, the start of the run
+			std::uint64_t id = 0;       // the coroutine the event belongs to
+			std::uint64_t duration = 0; // nanoseconds (runs only)
+			event_kind    kind = event_kind::spawn;
+			std::uint8_t  detail = 0;   // run_outcome for runs, wake_source for wakeups
+		};
+
+		// collects the events of all threads (see COUTIL_TRACE).
+		// each thread records into its own buffer, which are merged by snapshot() - the events of exited threads are kept until the next restart().
+		class recorder
+		{
+		private: // -- private utility info -- //
+
+			// the events recorded by one thread - its mutex is only contended by snapshot() and restart()
+			struct buffer
+			{
+				std::mutex         mutex;
+				std::vector<event> events;
+				buffer            *next = nullptr;
+			};
+
+		private: // -- data -- //
+
+			std::mutex                            mutex;   // guards the fields below
+			buffer                               *head = nullptr; // the buffers of all live threads
+			std::vector<event>                    retired; // the events of exited threads
+
+			std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+			std::atomic<std::uint64_t>            next_id{ 1 };
+
+		private: // -- private util -- //
+
+			recorder() = default;
+
+			// gets the calling thread's buffer (registering it on first use)
+			static buffer &_this_buffer()
+			{
+				thread_local struct _registration
+				{
+					buffer buf;
+
+					_registration()
+					{
+						recorder &rec = global();
+						std::lock_guard<std::mutex> lock(rec.mutex);
+						buf.next = rec.head;
+						rec.head = &buf;
+					}
+					~_registration()
+					{
+						recorder &rec = global();
+						std::lock_guard<std::mutex> lock(rec.mutex);
+						for (buffer **p = &rec.head; *p; p = &(*p)->next) if (*p == &buf) { *p = buf.next; break; }
+						rec.retired.insert(rec.retired.end(), buf.events.begin(), buf.events.end());
+					}
+				} registration;
+				return registration.buf;
+			}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			recorder(const recorder&) = delete;
+			recorder &operator=(const recorder&) = delete;
+
+		public: // -- interface -- //
+
+			// gets the recorder used by all executors
+			static recorder &global() { static recorder rec; return rec; }
+
+			// allocates a new coroutine id
+			std::uint64_t new_id() { return next_id.fetch_add(1, std::memory_order_relaxed); }
+			// gets the current trace time
+			std::uint64_t now() const { return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count(); }
+
+			// records an event into the calling thread's buffer
+			void record(const event &e)
+			{
+				buffer &buf = _this_buffer();
+				std::lock_guard<std::mutex> lock(buf.mutex);
+				buf.events.push_back(e);
+			}
+
+			// discards all recorded events and restarts the trace clock
+			void restart()
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				retired.clear();
+				for (buffer *b = head; b; b = b->next)
+				{
+					std::lock_guard<std::mutex> buf_lock(b->mutex);
+					b->events.clear();
+				}
+				epoch = std::chrono::steady_clock::now();
+			}
+			// returns a copy of the events recorded so far by all threads, in time order
+			std::vector<event> snapshot()
+			{
+				std::vector<event> events;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					events = retired;
+					for (buffer *b = head; b; b = b->next)
+					{
+						std::lock_guard<std::mutex> buf_lock(b->mutex);
+						events.insert(events.end(), b->events.begin(), b->events.end());
+					}
+				}
+				std::stable_sort(events.begin(), events.end(), [](const event &a, const event &b) { return a.time < b.time; });
+				return events;
+			}
+		};
+
+		inline constexpr char format_magic[4] = { 'C', 'U', 'T', 'R' };
+
+		// writes events to a binary stream - a 4 byte magic, a 64-bit count, then 26-byte records (time, id and duration as 64-bit fields, then kind and detail as bytes).
+		// all fields are little endian regardless of the host, so a trace can be read on a different machine than the one which wrote it.
+		inline void write(std::ostream &os, const std::vector<event> &events)
+		{
+			auto put = [&os](std::uint64_t v)
+			{
+				char bytes[8];
+				for (int i = 0; i < 8; ++i) bytes[i] = (char)(v >> 8 * i);
+				os.write(bytes, sizeof(bytes));
+			};
+
+			os.write(format_magic, sizeof(format_magic));
+			put(events.size());
+			for (const event &e : events)
+			{
+				put(e.time);
+				put(e.id);
+				put(e.duration);
+				os.put((char)e.kind);
+				os.put((char)e.detail);
+			}
+		}
+		// reads events written by write().
+		// if the stream does not hold a valid trace, throws std::invalid_argument.
+		inline std::vector<event> read(std::istream &is)
+		{
+			auto get = [&is]()
+			{
+				unsigned char bytes[8] = {};
+				is.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+				std::uint64_t v = 0;
+				for (int i = 0; i < 8; ++i) v |= (std::uint64_t)bytes[i] << 8 * i;
+				return v;
+			};
+
+			char magic[sizeof(format_magic)];
+			if (!is.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), format_magic))
+				throw std::invalid_argument("Stream does not contain a coutil trace");
+			std::uint64_t n = get();
+			if (!is) throw std::invalid_argument("Stream does not contain a coutil trace");
+
+			std::vector<event> events;
+			for (event e; n--; events.push_back(e))
+			{
+				e.time = get();
+				e.id = get();
+				e.duration = get();
+				e.kind = (event_kind)(std::uint8_t)is.get();
+				e.detail = (std::uint8_t)is.get();
+				if (!is || e.kind > event_kind::wake) throw std::invalid_argument("Truncated or corrupt coutil trace");
+			}
+			return events;
+		}
+
+		// -- simulation -- //
+
+		// scheduling policies for simulate() - a policy is any type with push(id, now) (a task became runnable) and bool pop(id&) (pick the next task to run).
+
+		// runs tasks in the order they became runnable
+		class fifo_policy
+		{
+		private: // -- data -- //
+
+			std::deque<std::uint64_t> ready;
+
+		public: // -- interface -- //
+
+			void push(std::uint64_t id, std::uint64_t) { ready.push_back(id); }
+			bool pop(std::uint64_t &id)
+			{
+				if (ready.empty()) return false;
+				id = ready.front();
+				ready.pop_front();
+				return true;
+			}
+		};
+		// runs the most recently runnable task first
+		class lifo_policy
+		{
+		private: // -- data -- //
+
+			std::vector<std::uint64_t> ready;
+
+		public: // -- interface -- //
+
+			void push(std::uint64_t id, std::uint64_t) { ready.push_back(id); }
+			bool pop(std::uint64_t &id)
+			{
+				if (ready.empty()) return false;
+				id = ready.back();
+				ready.pop_back();
+				return true;
+			}
+		};
+
+		// the predicted behavior of a trace under a policy
+		struct report
+		{
+			std::size_t   tasks = 0;        // coroutines which completed
+			std::uint64_t makespan = 0;     // nanoseconds from the first spawn to the last completion
+			double        throughput = 0;   // completed coroutines per second
+			std::uint64_t p50 = 0, p90 = 0, p99 = 0; // latency percentiles (spawn to completion) in nanoseconds
+		};
+
+		// replays a trace on a deterministic simulator with the given number of virtual cores (at least 1) under policy.
+		// each coroutine arrives at its recorded spawn time and runs its recorded segments in order - after a parked segment, it becomes runnable again after the delay until its recorded wakeup (yielded ones immediately).
+		// coroutines whose trace is incomplete (e.g. still running when it was taken) are ignored.
+		template<typename Policy>
+		report simulate(const std::vector<event> &events, Policy &&policy, std::size_t cores)
+		{
+			struct segment { std::uint64_t duration, delay; run_outcome outcome; };
+			struct task_info { std::uint64_t spawn = 0; bool spawned = false, done = false; std::vector<segment> segments; std::size_t next = 0; };
+
+			// rebuild each coroutine's segments from its events (in time order)
+			std::vector<const event*> sorted;
+			for (const event &e : events) sorted.push_back(&e);
+			std::stable_sort(sorted.begin(), sorted.end(), [](const event *a, const event *b) { return a->time < b->time; });
+
+			std::map<std::uint64_t, task_info> tasks;
+			std::map<std::uint64_t, std::uint64_t> parked_at; // id -> time its last parked run ended
+			for (const event *e : sorted)
+			{
+				task_info &t = tasks[e->id];
+				switch (e->kind)
+				{
+				case event_kind::spawn: t.spawn = e->time; t.spawned = true; break;
+				case event_kind::run:
+					t.segments.push_back({ e->duration, 0, (run_outcome)e->detail });
+					if ((run_outcome)e->detail == run_outcome::done) t.done = true;
+					else if ((run_outcome)e->detail == run_outcome::parked) parked_at[e->id] = e->time + e->duration;
+					break;
+				case event_kind::wake:
+					if (auto p = parked_at.find(e->id); p != parked_at.end() && !t.segments.empty())
+					{
+						t.segments.back().delay = e->time > p->second ? e->time - p->second : 0;
+						parked_at.erase(p);
+					}
+					break;
+				}
+			}
+			for (auto i = tasks.begin(); i != tasks.end(); ) i = i->second.spawned && i->second.done ? std::next(i) : tasks.erase(i);
+
+			report rep;
+			if (tasks.empty()) return rep;
+
+			// discrete event simulation - sim events are (time, seq, id): either a task becoming runnable or (if it is running until then) finishing a segment
+			typedef std::tuple<std::uint64_t, std::uint64_t, std::uint64_t> sim_event;
+			std::priority_queue<sim_event, std::vector<sim_event>, std::greater<sim_event>> pending;
+			std::uint64_t seq = 0, start = ~(std::uint64_t)0, end = 0;
+			for (auto &[id, t] : tasks) { pending.emplace(t.spawn, seq++, id); start = std::min(start, t.spawn); }
+
+			std::map<std::uint64_t, std::uint64_t> running_until; // id -> end of its current segment
+			std::vector<std::uint64_t> latencies;
+			std::size_t free_cores = cores ? cores : 1;
+			while (!pending.empty())
+			{
+				auto [now, s, id] = pending.top();
+				pending.pop();
+
+				if (auto r = running_until.find(id); r != running_until.end() && r->second == now)
+				{
+					// the task finished a segment
+					running_until.erase(r);
+					++free_cores;
+					task_info &t = tasks[id];
+					const segment &seg = t.segments[t.next++];
+					if (t.next == t.segments.size()) { latencies.push_back(now - t.spawn); end = std::max(end, now); }
+					else if (seg.outcome == run_outcome::parked) pending.emplace(now + seg.delay, seq++, id);
+					else policy.push(id, now);
+				}
+				else policy.push(id, now);
+
+				for (std::uint64_t next; free_cores && policy.pop(next); )
+				{
+					--free_cores;
+					task_info &t = tasks[next];
+					std::uint64_t until = now + t.segments[t.next].duration;
+					running_until[next] = until;
+					pending.emplace(until, seq++, next);
+				}
+			}
+
+			std::sort(latencies.begin(), latencies.end());
+			auto pct = [&](double p) { return latencies[std::min(latencies.size() - 1, (std::size_t)(p * latencies.size()))]; };
+			rep.tasks = latencies.size();
+			rep.makespan = end - start;
+			rep.throughput = rep.makespan ? rep.tasks * 1e9 / rep.makespan : 0;
+			rep.p50 = pct(0.50);
+			rep.p90 = pct(0.90);
+			rep.p99 = pct(0.99);
+			return rep;
+		}
+	}
+#endif
+
+	// ----------- //
+
+	// -- tasks -- //
+
+	// ----------- //
+
+	template<typename, typename> class basic_task;
+	template<typename> class any_awaitable;
+	class thread_pool;
+
+	namespace detail
+	{
+		template<typename T, typename InitialSuspend>
+		struct _basic_task_promise_type : _park_state, _live_metric<metrics::metric::live_tasks>
+		{
+			// this holds the state information about this coroutine (ret or exception)
+			std::variant<std::exception_ptr, T> stat;
+
+			auto get_return_object() { return basic_task<T, InitialSuspend>{ std::experimental::coroutine_handle<_basic_task_promise_type>::from_promise(*this) }; }
+
+			auto initial_suspend() const noexcept { return InitialSuspend{}; }
+			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+
+			template<typename U>
+			void return_value(U &&u) { stat.emplace<1>(std::forward<U>(u)); }
+
+			void unhandled_exception() { stat.emplace<0>(std::current_exception()); }
+		};
+		template<typename T, typename InitialSuspend>
+		struct _basic_task_promise_type<T&, InitialSuspend> : _park_state, _live_metric<metrics::metric::live_tasks>
+		{
+			// this holds the state information about this coroutine (ret or exception)
+			std::variant<std::exception_ptr, T*> stat;
+
+			auto get_return_object() { return basic_task<T&, InitialSuspend>{ std::experimental::coroutine_handle<_basic_task_promise_type>::from_promise(*this) }; }
+
+			auto initial_suspend() const noexcept { return InitialSuspend{}; }
+			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+
+			void return_value(T &p) { stat.emplace<1>(&p); }
+
+			void unhandled_exception() { stat.emplace<0>(std::current_exception()); }
+		};
+		template<typename T, typename InitialSuspend>
+		struct _basic_task_promise_type<T&&, InitialSuspend> : _park_state, _live_metric<metrics::metric::live_tasks>
+		{
+			// this holds the state information about this coroutine (ret or exception)
+			std::variant<std::exception_ptr, T*> stat;
+
+			auto get_return_object() { return basic_task<T&, InitialSuspend>{ std::experimental::coroutine_handle<_basic_task_promise_type>::from_promise(*this) }; }
+
+			auto initial_suspend() const noexcept { return InitialSuspend{}; }
+			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+
+			void return_value(T &&p) { stat.emplace<1>(&p); }
+
+			void unhandled_exception() { stat.emplace<0>(std::current_exception()); }
+		};
+		template<typename InitialSuspend>
+		struct _basic_task_promise_type<void, InitialSuspend> : _park_state, _live_metric<metrics::metric::live_tasks>
+		{
+			// the exception thrown during coroutine execution (if any)
+			std::exception_ptr ex;
+
+			auto get_return_object() { return basic_task<void, InitialSuspend>{ std::experimental::coroutine_handle<_basic_task_promise_type>::from_promise(*this) }; }
+
+			auto initial_suspend() const noexcept { return InitialSuspend{}; }
+			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+
+			void return_void() {}
+
+			void unhandled_exception() { ex = std::current_exception(); }
+		};
+	}
+
+	// basic_task represents a coroutine that co_returns a (single) value of type T.
+	// if an exception is thrown, it is caught and rethrown upon awaiting the result.
+	// if T is void, this represents a void-returning coroutine.
+	// if T is a reference type, represents a reference-returning coroutine (the reference category is preserved).
+	//     in this case the return value is stored as a pointer - it is the responsibility of the coroutine writer to guarantee the object outlives the coroutine.
+	// otherwise this represents a (regular) T-returning coroutine.
+	// T              - the return type of the coroutine (must not be cv-qualified).
+	// InitialSuspend - the type to return for initial_suspend() (empty brace initialized) (must not be cv-qualified).
+	template<typename T, typename InitialSuspend>
+	class basic_task
+	{
+	public: // -- promise -- //
+
+		static_assert(std::is_same_v<T, std::remove_cv_t<T>>, "T must not be cv-qualified");
+		static_assert(std::is_same_v<InitialSuspend, std::remove_cv_t<InitialSuspend>>, "InitialSuspend must not be cv-qualified");
+
+		typedef detail::_basic_task_promise_type<T, InitialSuspend> promise_type;
+		friend struct promise_type;
+
+		template<typename> friend class any_awaitable;
+		template<typename, typename> friend class task_sender;
+		friend class thread_pool;
+
+	private: // -- private utility info -- //
+
+		typedef std::experimental::coroutine_handle<promise_type> handle;
+
+		// constexpr control flags for performing compile-time branching in management functions
+		static inline constexpr bool void_mode = std::is_void_v<T>;
+		static inline constexpr bool ref_mode = std::is_reference_v<T>;
+
+	private: // -- data -- //
+
+		handle co = nullptr; // the raw coroutine handle
+
+	private: // -- private util -- //
+
+		explicit basic_task(handle h) : co(std::move(h)) {}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// constructs an empty basic_task (does not refer to any existing coroutine)
+		basic_task() = default;
+
+		// destroys the currently-held coroutine handle (if any)
+		~basic_task() { if (co) co.destroy(); }
+
+		basic_task(const basic_task&) = delete;
+		basic_task &operator=(const basic_task&) = delete;
+
+		// steals the handle of other - other is left in the empty state
+		basic_task(basic_task &&other) : co(std::exchange(other.co, nullptr)) {}
+		// discards the current coroutine handle and steals other's - other is left in the empty state.
+		// on self assignment, does nothing.
+		basic_task &operator=(basic_task &&other) { co = std::exchange(other.co, nullptr); return *this; }
+
+	public: // -- state information -- //
+
+		// returns true if the basic_task is currently in the empty state.
+		bool empty() const { return !co; }
+
+		// returns true if the basic_task is non-empty
+		explicit operator bool() const { return !empty(); }
+		// returns true if the basic_task is empty
+		bool operator!() const { return empty(); }
+
+	public: // -- coroutine control -- //
+
+		// returns true if the coroutine has completed execution (successfully or due to exception).
+		// if the basic_task is currently empty, throws bad_coroutine_access.
+		bool done() const
+		{
+			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+			return co.done();
+		}
+
+		// if the coroutine is not finished and not parked, resumes it, otherwise does nothing.
+		// if the basic_task is currently empty, throws bad_coroutine_access.
+		void resume()
+		{
+			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+			if (!co.done() && !co.promise().is_parked()) detail::_resume(co);
+		}
+
+		// sets a label identifying the coroutine in diagnostics (e.g. profiler samples) - the string must outlive the coroutine (e.g. a string literal).
+		// if the basic_task is currently empty, throws bad_coroutine_access.
+		void set_category(const char *category)
+		{
+			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+			co.promise().category = category;
+		}
+
+		// blocks until completion of the coroutine and gets the returned value.
+		// if the basic_task is currently empty, throws bad_coroutine_access.
+		// if the coroutine ended due to exception, rethrows the exception.
+		// after this operation (regardless of success) the basic_task is in the empty state (the coroutine is destroyed).
+		// T is void      - returns void.
+		// T is reference - returns the reference (preserving reference category).
+		// otherwise      - returns the stored object by value (move-constructed).
+		decltype(auto) wait()
+		{
+			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+			while (!co.done())
+			{
+				// if the coroutine is parked, sleep until the event source unparks it
+				if (co.promise().is_parked()) detail::_block_while_parked(co.promise());
+				else detail::_resume(co);
+			}
+
+			// create a sentry object that will set us to the empty state regardless of success (i.e. even if an exception is thrown)
+			struct _
+			{
+				handle &h;
+				_(handle &_h) : h(_h) {}
+				~_() { h.destroy(); h = nullptr; }
+			} sentry(co);
+			
+			if constexpr (void_mode)
+			{
+				if (co.promise().ex) std::rethrow_exception(co.promise().ex);
+			}
+			else if constexpr (ref_mode)
+			{
+				if (std::remove_reference_t<T> **p = std::get_if<1>(&co.promise().stat)) return static_cast<T>(**p); // cast is to preserve rvalue reference return type (otherwise would deduce to lvalue reference)
+				else std::rethrow_exception(std::get<0>(co.promise().stat));
+			}
+			else
+			{
+				if (T *ret = std::get_if<1>(&co.promise().stat)) return static_cast<T>(std::move(*ret)); // the cast is to return a move-constructed value
+				else std::rethrow_exception(std::get<0>(co.promise().stat));
+			}
+		}
+
+	public: // -- await interface -- //
+
+		bool           await_ready() { return done(); }
+		template<typename P>
+		COUTIL_SUSPEND_SITE void           await_suspend(std::experimental::coroutine_handle<P> h) { detail::_note_await(co.promise(), h, COUTIL_SITE()); }
+		decltype(auto) await_resume() { return wait(); }
+	};
+
+	// a task is a basic_task which starts immediately and suspends
+	template<typename T = void>
+	using task = basic_task<std::remove_cv_t<T>, std::experimental::suspend_never>;
+
+	// a lazy_task is a basic_task which suspends immediately upon creation
+	template<typename T = void>
+	using lazy_task = basic_task<std::remove_cv_t<T>, std::experimental::suspend_always>;
+
+	// any_awaitable is a type-erased basic_task that co_returns T, regardless of its InitialSuspend type.
+	// it holds only the raw coroutine handle and a pointer to a static manual vtable for the stored type (no allocation beyond the coroutine frame).
+	// if T is void, any basic_task can be stored and its result (if any) is discarded upon completion.
+	// otherwise the stored basic_task must return exactly T.
+	// T - the return type of the coroutine (must not be cv-qualified).
+	template<typename T>
+	class any_awaitable
+	{
+	private: // -- private utility info -- //
+
+		static_assert(std::is_same_v<T, std::remove_cv_t<T>>, "T must not be cv-qualified");
+
+		typedef std::experimental::coroutine_handle<> handle;
+
+		// the manual vtable for a stored coroutine type
+		struct vtable
+		{
+			T                    (*wait)(handle);  // waits on the coroutine and extracts the result (destroys the coroutine)
+			detail::_park_state &(*state)(handle); // gets the parking state of the coroutine
+		};
+
+		// the vtable used for a stored basic_task<U, InitialSuspend> - reconstructs the original basic_task handle to forward each operation.
+		template<typename U, typename InitialSuspend>
+		struct task_vtable
+		{
+			typedef basic_task<U, InitialSuspend> task_t;
+
+			static T _wait(handle h)
+			{
+				if constexpr (std::is_void_v<T>) task_t{ task_t::handle::from_address(h.address()) }.wait();
+				else return task_t{ task_t::handle::from_address(h.address()) }.wait();
+			}
+			static detail::_park_state &_state(handle h) { return task_t::handle::from_address(h.address()).promise(); }
+
+			static inline constexpr vtable value{ &_wait, &_state };
+		};
+
+	private: // -- data -- //
+
+		handle        co = nullptr; // the raw (type-erased) coroutine handle
+		const vtable *vt = nullptr; // the vtable for the stored coroutine type
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// constructs an empty any_awaitable (does not refer to any existing coroutine)
+		any_awaitable() = default;
+
+		// steals the handle of the given basic_task - task is left in the empty state.
+		// if task is empty, this any_awaitable is also empty.
+		template<typename U, typename InitialSuspend, std::enable_if_t<std::is_void_v<T> || std::is_same_v<T, U>, int> = 0>
+		any_awaitable(basic_task<U, InitialSuspend> &&task) : co(std::exchange(task.co, nullptr)), vt(&task_vtable<U, InitialSuspend>::value) {}
+
+		// destroys the currently-held coroutine handle (if any)
+		~any_awaitable() { if (co) co.destroy(); }
+
+		any_awaitable(const any_awaitable&) = delete;
+		any_awaitable &operator=(const any_awaitable&) = delete;
+
+		// steals the handle of other - other is left in the empty state
+		any_awaitable(any_awaitable &&other) : co(std::exchange(other.co, nullptr)), vt(other.vt) {}
+		// destroys the current coroutine (if any) and steals other's - other is left in the empty state.
+		// on self assignment, does nothing.
+		any_awaitable &operator=(any_awaitable &&other)
+		{
+			if (this != &other)
+			{
+				if (co) co.destroy();
+				co = std::exchange(other.co, nullptr);
+				vt = other.vt;
+			}
+			return *this;
+		}
+
+	public: // -- state information -- //
+
+		// returns true if the any_awaitable is currently in the empty state.
+		bool empty() const { return !co; }
+
+		// returns true if the any_awaitable is non-empty
+		explicit operator bool() const { return !empty(); }
+		// returns true if the any_awaitable is empty
+		bool operator!() const { return empty(); }
+
+	public: // -- coroutine control -- //
+
+		// returns true if the coroutine has completed execution (successfully or due to exception).
+		// if the any_awaitable is currently empty, throws bad_coroutine_access.
+		bool done() const
+		{
+			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+			return co.done();
+		}
+
+		// if the coroutine is not finished and not parked, resumes it, otherwise does nothing.
+		// if the any_awaitable is currently empty, throws bad_coroutine_access.
+		void resume()
+		{
+			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+			if (!co.done() && !vt->state(co).is_parked()) detail::_resume(co, vt->state(co));
+		}
+
+		// blocks until completion of the coroutine and gets the returned value (see basic_task::wait()).
+		// if the any_awaitable is currently empty, throws bad_coroutine_access.
+		// after this operation (regardless of success) the any_awaitable is in the empty state (the coroutine is destroyed).
+		T wait()
+		{
+			if (empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+			return vt->wait(std::exchange(co, nullptr));
+		}
+
+	public: // -- await interface -- //
+
+		bool await_ready() { return done(); }
+		template<typename P>
+		COUTIL_SUSPEND_SITE void await_suspend(std::experimental::coroutine_handle<P> h) { detail::_note_await(vt->state(co), h, COUTIL_SITE()); }
+		T    await_resume() { return wait(); }
+	};
+
+	// an any_task is a type-erased basic_task of any return type (the result is discarded)
+	using any_task = any_awaitable<void>;
+
+	namespace detail
+	{
+		// gets if type T is any kind of basic_task
+		template<typename T>
+		struct _is_task : std::false_type {};
+		template<typename T, typename InitialSuspend>
+		struct _is_task<basic_task<T, InitialSuspend>> : std::true_type {};
+		template<typename T>
+		struct _is_task<any_awaitable<T>> : std::true_type {};
+	}
+
+	// gets if type T is any kind of (potentially cv-qualified) basic_task or any_awaitable
+	template<typename T>
+	using is_task = detail::_is_task<std::remove_cv_t<T>>;
+	template<typename T>
+	inline constexpr bool is_task_v = is_task<T>::value;
+	
+	// given one or more tasks, resume()s them in a loop until all of them are done().
+	// wait() is not actually called on any task, so the results are not extracted.
+	template<typename ...T, std::enable_if_t<std::conjunction_v<is_task<T>...>, int> = 0>
+	void wait_all(T &...tasks)
+	{
+		while ((... | (tasks.resume(), !tasks.done())));
+	}
+	// given one or more tasks, resume()s them in a loop until at least one of them is done().
+	// wait() is not actually called on any task, so the results are not extracted.
+	template<typename ...T, std::enable_if_t<std::conjunction_v<is_task<T>...>, int> = 0>
+	void wait_any(T &...tasks)
+	{
+		while (!(... | (tasks.resume(), tasks.done())));
+	}
+
+	// ------------ //
+
+	// -- timers -- //
+
+	// ------------ //
+
+	// timer_service runs callbacks at deadlines on a single background thread (started on first use) - it is the shared timer facility behind sleep_until() and deadline-bounded waits.
+	// timers are intrusive entries owned by the caller, so scheduling only allocates a queue node.
+	class timer_service
+	{
+	public: // -- entry interface -- //
+
+		typedef std::chrono::steady_clock clock;
+
+		// a timer - fire is invoked on the timer thread with the entry itself once deadline has passed (the entry must stay alive until it fires or is cancelled)
+		struct entry
+		{
+			clock::time_point deadline;
+			void            (*fire)(entry&) = nullptr;
+
+		private: // -- private utility info -- //
+
+			friend class timer_service;
+
+			std::multimap<clock::time_point, entry*>::iterator pos;
+			bool                                             queued = false;
+		};
+
+	private: // -- data -- //
+
+		std::mutex                               mutex;
+		std::condition_variable                  cv;       // signalled when the earliest deadline changes or the service is stopping
+		std::condition_variable                  fired_cv; // signalled when a callback returns
+		std::multimap<clock::time_point, entry*> queue;
+		entry                                   *firing = nullptr; // the entry whose callback is running (if any)
+		bool                                     stopping = false;
+		std::thread                              worker;
+
+	private: // -- private util -- //
+
+		void _work()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping)
+			{
+				if (queue.empty()) cv.wait(lock);
+				else if (queue.begin()->first <= clock::now())
+				{
+					entry *e = queue.begin()->second;
+					queue.erase(queue.begin());
+					e->queued = false;
+					firing = e;
+
+					lock.unlock();
+					e->fire(*e);
+					lock.lock();
+
+					firing = nullptr;
+					fired_cv.notify_all();
+				}
+				else
+				{
+					clock::time_point next = queue.begin()->first; // copied - the entry may be cancelled while we wait
+					cv.wait_until(lock, next);
+				}
+			}
+		}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		timer_service() = default;
+
+		// stops the timer thread - pending timers never fire
+		~timer_service()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			cv.notify_all();
+			if (worker.joinable()) worker.join();
+		}
+
+		timer_service(const timer_service&) = delete;
+		timer_service &operator=(const timer_service&) = delete;
+
+		// gets the timer service shared by coutil utilities
+		static timer_service &global() { static timer_service service; return service; }
+
+	public: // -- interface -- //
+
+		// schedules e to fire at e.deadline - e must not already be scheduled
+		void schedule(entry &e)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!worker.joinable()) worker = std::thread([this] { _work(); });
+
+				e.pos = queue.emplace(e.deadline, &e);
+				e.queued = true;
+				if (e.pos != queue.begin()) return;
+			}
+			cv.notify_one(); // new earliest deadline
+		}
+
+		// cancels e - returns true if it had not fired yet (it never will).
+		// if its callback is currently running, waits for it to return (afterwards the entry can safely be destroyed).
+		// cancelling an entry which is not scheduled does nothing.
+		bool cancel(entry &e)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (e.queued)
+			{
+				queue.erase(e.pos);
+				e.queued = false;
+				return true;
+			}
+			fired_cv.wait(lock, [&] { return firing != &e; });
+			return false;
+		}
+	};
+
+	// awaitable which parks the awaiting coroutine until a deadline (see sleep_until())
+	class sleep_awaitable : private timer_service::entry
+	{
+	private: // -- data -- //
+
+		detail::_parker parker;
+
+		static void _fire(timer_service::entry &e) { static_cast<sleep_awaitable&>(e).parker.unpark(); }
+
+	public: // -- ctor / dtor / asgn -- //
+
+		explicit sleep_awaitable(timer_service::clock::time_point d) { deadline = d; fire = &_fire; }
+
+		sleep_awaitable(const sleep_awaitable&) = delete;
+		sleep_awaitable &operator=(const sleep_awaitable&) = delete;
+
+	public: // -- await interface -- //
+
+		bool await_ready() const { return deadline <= timer_service::clock::now(); }
+		template<typename P>
+		COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+		{
+			parker.park(h, COUTIL_SITE(), metrics::primitive::timer);
+			timer_service::global().schedule(*this);
+			return parker.parked();
+		}
+		void await_resume() { timer_service::global().cancel(*this); } // waits for the timer callback to return (it may still be running)
+	};
+
+	// returns an awaitable which parks the awaiting coroutine until deadline (on the shared timer_service)
+	inline sleep_awaitable sleep_until(timer_service::clock::time_point deadline) { return sleep_awaitable{ deadline }; }
+	// returns an awaitable which parks the awaiting coroutine for (at least) the given duration
+	template<typename Rep, typename Period>
+	sleep_awaitable sleep_for(std::chrono::duration<Rep, Period> d) { return sleep_awaitable{ timer_service::clock::now() + std::chrono::duration_cast<timer_service::clock::duration>(d) }; }
+
+	// ---------------- //
+
+	// -- generators -- //
+
+	// ---------------- //
+
+	namespace detail
+	{
+		struct _generator_access;
+	}
+
+	// the outcome of a deadline-bounded generator advance (see basic_generator::iterator::next_until())
+	enum class next_status { value, timeout, end };
+
+	template<typename T>
+	struct next_result
+	{
+		next_status      status = next_status::end;
+		std::optional<T> value; // the yielded value (if status is value)
+
+		// returns true if a value was obtained
+		explicit operator bool() const noexcept { return status == next_status::value; }
+	};
+
+	// basic_generator represents a coroutine that co_yields zero or more values T and optionally co_returns (nothing) to end execution.
+	// has the ability to iterate over the generated sequence of values as a (single-pass) input iterator.
+	// execution of the coroutine body does not begin until a yield value is requested.
+	template<typename T>
+	class basic_generator
+	{
+	public: // -- promise -- //
+
+		static_assert(!std::is_reference_v<T>, "T in basic_generator<T> cannot be of reference type");
+
+		struct promise_type;
+		typedef std::experimental::coroutine_handle<promise_type> handle;
+
+		struct promise_type : detail::_park_state, detail::_live_metric<metrics::metric::live_generators>
+		{
+			std::variant<std::exception_ptr, T> stat; // holds the state information about this coroutine (ret or exception)
+			bool yield_flag = false;                  // flag used to mark when a yield value is obtained
+
+			auto get_return_object() { return basic_generator{ handle::from_promise(*this) }; }
+
+			auto initial_suspend() const noexcept { return std::experimental::suspend_always{}; }
+			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+
+			template<typename U>
+			auto yield_value(U &&u)
+			{
+				// if we already have a T object, move assign it - otherwise move construct it
+				if (T *p = std::get_if<1>(&stat)) *p = std::forward<U>(u);
+				else stat.emplace<1>(std::forward<U>(u));
+
+				// mark that we now have a yield value
+				yield_flag = true;
+
+				// suspend so that we can use it
+				return std::experimental::suspend_always{};
+			}
+
+			void unhandled_exception()
+			{
+				stat.emplace<0>(std::current_exception());
+			}
+		};
+
+	private: // -- data -- //
+
+		handle co = nullptr; // the raw coroutine handle
+
+	private: // -- private util -- //
+
+		friend struct detail::_generator_access;
+
+		basic_generator(handle h) : co(std::move(h)) {}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// constructs an empty basic_generator (does not refer to any existing coroutine)
+		basic_generator() = default;
+
+		// destroys the currently-held coroutine handle (if any)
+		~basic_generator() { if (co) co.destroy(); }
+
+		basic_generator(const basic_generator&) = delete;
+		basic_generator &operator=(const basic_generator&) = delete;
+
+		// steals the handle of other - other is left in the empty state
+		basic_generator(basic_generator &&other) : co(std::exchange(other.co, nullptr)) {}
+		// discards the current coroutine handle and steals other's - other is left in the empty state.
+		// on self assignment, does nothing.
+		basic_generator &operator=(basic_generator &&other) { co = std::exchange(other.co, nullptr); return *this; }
+
+	public: // -- state information -- //
+
+		// returns true if the basic_generator is currently in the empty state.
+		bool empty() const { return !co; }
+
+		// returns true if the basic_generator is non-empty
+		explicit operator bool() const { return !empty(); }
+		// returns true if the basic_generator is empty
+		bool operator!() const { return empty(); }
+
+	public: // -- iterator -- //
+
+		class iterator
+		{
+		public: // -- pseudo-iterator -- //
+
+			class pseudo_iterator
+			{
+			private: // -- data -- //
+
+				iterator            *it;
+				detail::_park_state *awaiter = nullptr; // the coroutine recorded as awaiting the advance (see detail::_note_await())
+
+			private: // -- private util -- //
+
+				friend class iterator;
+
+				// constructs a pseudo_iterator to advance the given iterator.
+				// the provided iterator must have a valid (non-null) coroutine handle.
+				explicit pseudo_iterator(iterator &i) : it(&i)
+				{
+					// if an advance was left pending by a timed out next_until(), finish that one instead of starting another
+					if (std::exchange(it->advancing, false)) return;
+
+					// clear the yield flag and resume execution of the coroutine
+					it->co.promise().yield_flag = false;
+					detail::_resume(it->co);
+				}
+
+				// returns true if the increment process has completed
+				bool done()
+				{
+					// if the coroutine has finished (no yield value) or we got a yield value, we're done with the increment process
+					return it->co.done() || it->co.promise().yield_flag;
+				}
+				// blocks until completion of the increment process and updates the iterator source.
+				// after everything is completed, sets this pseudo-iterator to the empty state.
+				void wait()
+				{
+					// wait for completion of the increment process (if the coroutine is parked, sleep until the event source unparks it)
+					while (!done())
+					{
+						if (it->co.promise().is_parked()) detail::_block_while_parked(it->co.promise());
+						else detail::_resume(it->co);
+					}
+					detail::_end_await(it->co.promise(), std::exchange(awaiter, nullptr));
+					
+					// if the coroutine has finished execution (no yield value) destroy the coroutine and null it.
+					// this effectively sets the iterator it was sourced from to the end iterator state.
+					if (it->co.done()) { it->co.destroy(); it->co = nullptr; }
+
+					// we're done now - no longer need the coroutine handle.
+					// null the raw pointer we have so that the destructor won't try to wait() again
+					it = nullptr;
+				}
+
+			public: // -- ctor / dtor / asgn -- //
+
+				// blocks and advances the stored iterator to the next yield value
+				~pseudo_iterator()
+				{
+					if (it) wait();
+				}
+
+				pseudo_iterator(const pseudo_iterator&) = delete;
+				pseudo_iterator &operator=(const pseudo_iterator&) = delete;
+
+				// passes on the responsibility for advancing the stored iterator to a new pseudo_iterator.
+				pseudo_iterator(pseudo_iterator &&other) : it(std::exchange(other.it, nullptr)), awaiter(std::exchange(other.awaiter, nullptr)) {}
+				pseudo_iterator &operator=(pseudo_iterator&&) = delete;
+
+			public: // -- await interface -- //
+
+				bool await_ready() { return done(); }
+				template<typename P>
+				COUTIL_SUSPEND_SITE void await_suspend(std::experimental::coroutine_handle<P> h) { awaiter = detail::_note_await(it->co.promise(), h, COUTIL_SITE()); }
+				void await_resume() { wait(); }
+			};
+
+		public: // -- iterator traits -- //
+
+			typedef std::input_iterator_tag iterator_category;
+			typedef T                       value_type;
+			typedef std::ptrdiff_t          difference_type;
+			typedef T                      *pointer_type;
+			typedef T                      &reference_type;
+
+			// awaitable which advances the iterator unless a deadline passes first (see next_until()).
+			// while the generator is parked, the awaiting coroutine is parked with this as its resume gate - each wake drives the generator from the gate,
+			// so if the generator parks again the awaiting coroutine goes straight back to sleep instead of being resumed.
+			class next_awaitable : private timer_service::entry, private detail::_resume_gate
+			{
+			private: // -- data -- //
+
+				iterator       &it;
+				detail::_parker parker;
+				bool            timed_out = false;
+
+			private: // -- private util -- //
+
+				static void _fire(timer_service::entry &e)
+				{
+					// the awaiting coroutine only waits for the generator while registered with it, so the generator is still alive if we can take the registration back
+					next_awaitable &self = static_cast<next_awaitable&>(e);
+					if (detail::_parker::unwatch(self.it.co.promise(), self.parker))
+					{
+						self.timed_out = true;
+						self.parker.unpark();
+					}
+				}
+				static bool _pass(detail::_resume_gate &g) { return static_cast<next_awaitable&>(g)._drive(); }
+
+				// resumes the generator until it yields, ends or parks - returns false if it parked
+				bool _step()
+				{
+					auto &p = it.co.promise();
+					while (!it.co.done() && !p.yield_flag)
+					{
+						if (p.is_parked()) return false;
+						detail::_resume(it.co);
+					}
+					return true;
+				}
+
+				// drives the generator until it yields or ends, or the deadline passes - returns true once the awaiting coroutine can go on.
+				// whenever the generator parks, (re)parks the awaiting coroutine and registers it to be woken by the generator's unpark - returns false if it stays parked.
+				bool _drive()
+				{
+					auto &p = it.co.promise();
+					while (!timed_out && !_step())
+					{
+						// if the generator was unparked before we could register, keep driving it
+						parker.repark();
+						if (!detail::_parker::watch(p, parker)) { parker.retract(); continue; }
+
+						// the deadline may have passed before we registered (with nobody for the timer to wake) - if so, take the registration back
+						if (deadline > timer_service::clock::now()) return false;
+						if (!detail::_parker::unwatch(p, parker)) return false; // a wake is already on its way
+						parker.retract();
+						timed_out = true;
+					}
+					parker.parked_state()->gate = nullptr;
+					parker.retract();
+					return true;
+				}
+
+				next_result<T> _finish()
+				{
+					it.advancing = false;
+					if (!it.co.done()) return { next_status::value, std::move(std::get<1>(it.co.promise().stat)) };
+
+					std::exception_ptr ex;
+					if (auto e = std::get_if<0>(&it.co.promise().stat)) ex = *e;
+					it.co.destroy();
+					it.co = nullptr;
+					if (ex) std::rethrow_exception(ex);
+					return {};
+				}
+
+			public: // -- ctor / dtor / asgn -- //
+
+				next_awaitable(iterator &i, timer_service::clock::time_point d) : it(i)
+				{
+					if (!it.co) throw std::invalid_argument("Attempt to increment past end iterator");
+					if (it.co.promise().link) throw std::invalid_argument("Generator is already attached to another driver");
+					deadline = d;
+					fire = &_fire;
+					pass = &_pass;
+				}
+
+				next_awaitable(const next_awaitable&) = delete;
+				next_awaitable &operator=(const next_awaitable&) = delete;
+
+			public: // -- await interface -- //
+
+				bool await_ready()
+				{
+					if (!std::exchange(it.advancing, true)) it.co.promise().yield_flag = false;
+					if (_step()) return true;
+					timed_out = deadline <= timer_service::clock::now();
+					return timed_out;
+				}
+				template<typename P>
+				COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+				{
+					const void *site = COUTIL_SITE();
+					parker.park(h, site, metrics::primitive::generator);
+					detail::_note_await(it.co.promise(), h, site);
+					h.promise().gate = this;
+
+					// the timer stays scheduled while the generator parks again and again - _drive() covers it having fired while nobody was registered
+					if (deadline != timer_service::clock::time_point::max()) timer_service::global().schedule(*this);
+					return !_drive();
+				}
+				next_result<T> await_resume()
+				{
+					timer_service::global().cancel(*this);
+					detail::_end_await(it.co.promise(), parker.parked_state()); // a timed out advance is left pending, but nothing awaits it anymore
+					if (timed_out) return { next_status::timeout, std::nullopt };
+					return _finish();
+				}
+			};
+
+		private: // -- data -- //
+
+			handle co;               // the raw coroutine handle (from the generator)
+			bool   advancing = false; // true if an advance was started by next_until() but has not yet completed
+
+		private: // -- private util -- //
+
+			friend class basic_generator;
+			friend struct detail::_generator_access;
+
+			explicit iterator(handle h) : co(std::move(h))
+			{
+				// if we have a good coroutine, advance once to get the first value
+				if (co) ++*this;
+			}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			iterator() = default;
+
+			~iterator() { if (co) co.destroy(); }
+
+			iterator(const iterator&) = delete;
+			iterator &operator=(const iterator&) = delete;
+
+			// steals the iteration handle from other - other is "empty" after this.
+			iterator(iterator &&other) : co(std::exchange(other.co, nullptr)), advancing(std::exchange(other.advancing, false)) {}
+			// discards the current iterator handle and steals other's - other is "empty" after this.
+			// self assignment is no-op.
+			iterator &operator=(iterator &&other) { co = std::exchange(other.co, nullptr); advancing = std::exchange(other.advancing, false); return *this; }
+
+		public: // -- iterator interface -- //
+
+			// gets the currently-stored (most-recently-yielded) value.
+			// if an exception caused the coroutine to end prematurely, rethrows the exception.
+			const T &operator*() const&
+			{
+				// if we have an exception, rethrow it
+				if (auto ex = std::get_if<0>(&co.promise().stat); ex && *ex) std::rethrow_exception(*ex);
+
+				return std::get<1>(co.promise().stat);
+			}
+			T operator*() &&
+			{
+				// if we have an exception, rethrow it
+				if (auto ex = std::get_if<0>(&co.promise().stat); ex && *ex) std::rethrow_exception(*ex);
+
+				return std::move(std::get<1>(co.promise().stat));
+			}
+
+			// advances to the next yield value.
+			// this can be performed asyncronously with co_await.
+			// otherwise the destruction of the pseudo_iterator performs the operation synchronously.
+			// exceptions from this action are propagated through the dereferencing operator.
+			pseudo_iterator operator++() &
+			{
+				// make sure we have a valid (non-null) coroutine handle
+				if (!co) throw std::invalid_argument("Attempt to increment past end iterator");
+				return pseudo_iterator{*this};
+			}
+			pseudo_iterator operator++() && = delete;
+
+			// returns an awaitable which advances to the next yield value and yields it (moved out) - e.g. co_await it.next_until(deadline).
+			// if the generator is parked (waiting on some event) and the deadline passes first, yields a timeout result instead and leaves the advance pending:
+			// a later next_until() (or increment) picks up where it left off, so no value is lost. the deadline is tracked by the shared timer_service.
+			// if the generator ends, yields an end result and the iterator becomes the end iterator (if it ended due to exception, the exception is rethrown).
+			// a deadline of time_point::max() never times out (and schedules no timer).
+			// if this is the end iterator, or the generator is being driven by something else (e.g. merge_ready()), throws std::invalid_argument.
+			next_awaitable next_until(timer_service::clock::time_point deadline) & { return next_awaitable{ *this, deadline }; }
+
+			friend bool operator==(const iterator &a, const iterator &b)
+			{
+				// iterator is a uniquely-owning type, so the only way they can be equal is if they're both invalid (end) iterators
+				return !a.co && !b.co;
+			}
+			friend bool operator!=(const iterator &a, const iterator &b) { return !(a == b); }
+		};
+
+		// gets the begin iterator of this generator.
+		// this operation steals the coroutine handle from this object - i.e. the generator is empty after this operation.
+		// if the generator is currently empty, returns the end iterator.
+		iterator begin() { return iterator{ std::exchange(co, nullptr) }; }
+		// returns the end iterator for this generator - this generator is not modified by this action.
+		iterator end() const { return iterator{}; }
+	};
+
+	template<typename T>
+	using generator = basic_generator<T>;
+
+	namespace detail
+	{
+		// grants coutil utilities access to the raw coroutine handle of a generator
+		struct _generator_access
+		{
+			template<typename T>
+			static typename basic_generator<T>::handle &handle(basic_generator<T> &gen) { return gen.co; }
+
+			// steals the coroutine of gen into an iterator without advancing it - the first advance is left pending, to be started by next_until()
+			template<typename T>
+			static typename basic_generator<T>::iterator pending_begin(basic_generator<T> &gen)
+			{
+				typename basic_generator<T>::iterator it;
+				it.co = std::exchange(gen.co, nullptr);
+				it.advancing = (bool)it.co;
+				return it;
+			}
+		};
+
+		// wake state shared by all sources of a merge_ready()
+		struct _merge_state
+		{
+			static inline constexpr std::uint64_t waiting = std::uint64_t(1) << 63;
+
+			std::atomic<std::uint64_t> word{ 0 };       // bit i is set once source i was unparked (until the merge loop takes it) - the top bit is set while the merged generator waits on parker
+			_parker                   *parker = nullptr; // the merged generator's parker while it waits for a source
+		};
+
+		// wake link attached to each source of merge_ready() - unparking a source flags it in the shared word and unparks the merged generator if it is waiting for a source.
+		// the flag stands in for clearing the park of the source (the merge loop does that once it takes the flag), so setting it releases the source and claims the waiter in one step.
+		// after that the merge may run to completion at any time, so nothing but a claimed waiter (which stays parked until unparked here) is touched.
+		struct _merge_link : _wake_link
+		{
+			_merge_state *merge = nullptr;
+			std::uint64_t bit = 0;
+
+			_merge_link() { notify = &_notify; }
+
+			static void _notify(_wake_link &l, _park_state&)
+			{
+				_merge_link &m = static_cast<_merge_link&>(l);
+				std::atomic<std::uint64_t> &word = m.merge->word;
+				_parker *const &waiting_parker = m.merge->parker;
+				const std::uint64_t bit = m.bit;
+
+				std::uint64_t prev = word.load(std::memory_order_acquire);
+				_parker *w;
+				do w = prev & _merge_state::waiting ? waiting_parker : nullptr;
+				while (!word.compare_exchange_weak(prev, (prev | bit) & ~_merge_state::waiting, std::memory_order_acq_rel, std::memory_order_acquire));
+				if (w) w->unpark();
+			}
+		};
+
+		// awaitable which parks a merged generator until one of its sources is unparked
+		class _merge_wait
+		{
+		private: // -- data -- //
+
+			_merge_state &merge;
+			_parker       parker;
+
+		public: // -- ctor / dtor / asgn -- //
+
+			explicit _merge_wait(_merge_state &m) : merge(m) {}
+
+			_merge_wait(const _merge_wait&) = delete;
+			_merge_wait &operator=(const _merge_wait&) = delete;
+
+		public: // -- await interface -- //
+
+			bool await_ready() { return false; }
+			template<typename P>
+			COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+			{
+				parker.park(h, COUTIL_SITE(), metrics::primitive::generator);
+				merge.parker = &parker;
+
+				// a source may have been unparked since the merge loop last looked - if so, continue right away
+				std::uint64_t expected = 0;
+				if (!merge.word.compare_exchange_strong(expected, _merge_state::waiting, std::memory_order_acq_rel, std::memory_order_acquire)) parker.retract();
+				return parker.parked();
+			}
+			void await_resume() {}
+		};
+	}
+
+	// given one or more generators, returns a generator which yields each of their values (paired with the index of its source generator) in the order they become ready.
+	// a source is only resumed once it is runnable - a parked source (e.g. one awaiting a sender) is not touched again until it is unparked (see detail::_wake_link).
+	// if no source is runnable, the merged generator parks until one is unparked (i.e. it is itself asynchronous, and its driver is woken by the source rather than polling it).
+	// the merged generator ends once all sources have ended - if a source ends due to exception, the exception is propagated.
+	// the generators are taken by value, so the caller must move them in.
+	// if a source is already attached to another driver, the merged generator throws std::invalid_argument when first advanced.
+	template<typename T, typename ...Gens, std::enable_if_t<std::conjunction_v<std::is_same<Gens, basic_generator<T>>...>, int> = 0>
+	basic_generator<std::pair<std::size_t, T>> merge_ready(basic_generator<T> gen, Gens ...gens)
+	{
+		constexpr std::size_t N = 1 + sizeof...(Gens);
+
+		static_assert(N < 64, "merge_ready() supports at most 63 sources");
+
+		detail::_merge_state merge;
+		detail::_merge_link  links[N];
+		basic_generator<T>   sources[N] = { std::move(gen), std::move(gens)... };
+
+		// attach the wake links and mark each (non-empty) source as runnable
+		std::uint64_t runnable = 0; // the sources which can be resumed right away
+		std::size_t live = 0;
+		for (std::size_t i = 0; i < N; ++i)
+		{
+			links[i].merge = &merge;
+			links[i].bit = std::uint64_t(1) << i;
+			if (auto &h = detail::_generator_access::handle(sources[i]))
+			{
+				if (h.promise().link) throw std::invalid_argument("Generator is already attached to another driver");
+				h.promise().link = &links[i];
+				runnable |= links[i].bit;
+				++live;
+			}
+		}
+
+		while (live)
+		{
+			// take up the sources unparked since we last looked - their wake flag stood in for clearing the park, which is left to us
+			if (std::uint64_t woken = merge.word.exchange(0, std::memory_order_acquire))
+			{
+				for (std::size_t i = 0; i < N; ++i)
+					if (woken & links[i].bit) detail::_generator_access::handle(sources[i]).promise().parked.store(0, std::memory_order_relaxed);
+				runnable |= woken;
+			}
+			if (!runnable) { co_await detail::_merge_wait{ merge }; continue; }
+
+			for (std::size_t i = 0; i < N; ++i)
+			{
+				if (!(runnable & links[i].bit)) continue;
+
+				auto &h = detail::_generator_access::handle(sources[i]);
+				auto &p = h.promise();
+				p.yield_flag = false;
+				detail::_resume(h);
+
+				if (h.done())
+				{
+					if (auto ex = std::get_if<0>(&p.stat); ex && *ex) std::rethrow_exception(*ex);
+					h.destroy();
+					h = nullptr;
+					runnable &= ~links[i].bit;
+					--live;
+				}
+				else
+				{
+					// unless the source parked, it can be resumed again right away (if it did park, unparking it flags it again)
+					if (p.is_parked()) runnable &= ~links[i].bit;
+					if (p.yield_flag) co_yield std::pair<std::size_t, T>(i, std::move(std::get<1>(p.stat)));
+				}
+			}
+		}
+	}
+
+	// rate-shaping operators - each takes a (possibly asynchronous) source generator by value and returns a generator which yields a thinned-out or batched version of its values.
+	// the source is advanced with next_until(), so while waiting on it the operator is parked rather than spinning (even if the source parks several times per value), and its windows are tracked by the shared timer_service.
+	// if the source ends due to exception, the exception is propagated.
+
+	// returns a generator which yields a source value only once the source has been quiet for the given period - a value followed by another within the period is dropped.
+	// when the source ends, the last value (if still pending) is yielded right away.
+	template<typename T, typename Rep, typename Period>
+	basic_generator<T> debounce(basic_generator<T> gen, std::chrono::duration<Rep, Period> period)
+	{
+		const auto quiet = std::chrono::duration_cast<timer_service::clock::duration>(period);
+		auto it = detail::_generator_access::pending_begin(gen);
+		std::optional<T> pending;
+
+		for (bool open = it != gen.end(); open; )
+		{
+			next_result<T> r = co_await it.next_until(pending ? timer_service::clock::now() + quiet : timer_service::clock::time_point::max());
+			if (r) { pending = std::move(r.value); continue; }
+
+			open = r.status != next_status::end;
+			if (pending) { co_yield std::move(*pending); pending.reset(); }
+		}
+	}
+
+	// returns a generator which yields the first value of a burst right away and then at most one value per period - the latest value received during a period is yielded at its end.
+	// a period only starts when a value is yielded, so a lone value is never delayed.
+	template<typename T, typename Rep, typename Period>
+	basic_generator<T> throttle(basic_generator<T> gen, std::chrono::duration<Rep, Period> period)
+	{
+		const auto window = std::chrono::duration_cast<timer_service::clock::duration>(period);
+		auto it = detail::_generator_access::pending_begin(gen);
+		std::optional<T> latest;
+
+		for (bool open = it != gen.end(); open; )
+		{
+			// nothing to yield - wait for the next burst
+			next_result<T> r = co_await it.next_until(timer_service::clock::time_point::max());
+			if (!r) break;
+			latest = std::move(r.value);
+
+			// yield the latest value and collect the next for a period, until a period passes without any
+			while (latest)
+			{
+				const auto window_end = timer_service::clock::now() + window;
+				co_yield std::move(*latest);
+				latest.reset();
+
+				while (open && (r = co_await it.next_until(window_end))) latest = std::move(r.value);
+				open = r.status != next_status::end;
+			}
+		}
+	}
+
+	// returns a generator which yields the latest source value at the end of each period, if one was received during it (periods without values yield nothing).
+	// when the source ends, the last value (if not yet yielded) is yielded right away.
+	template<typename T, typename Rep, typename Period>
+	basic_generator<T> sample(basic_generator<T> gen, std::chrono::duration<Rep, Period> period)
+	{
+		const auto interval = std::chrono::duration_cast<timer_service::clock::duration>(period);
+		auto it = detail::_generator_access::pending_begin(gen);
+		std::optional<T> latest;
+
+		auto tick = timer_service::clock::now() + interval;
+		for (bool open = it != gen.end(); open; )
+		{
+			next_result<T> r = co_await it.next_until(tick);
+			if (r) { latest = std::move(r.value); continue; }
+
+			if (r.status == next_status::timeout)
+			{
+				// if the consumer fell behind, skip the missed ticks rather than yielding a burst of them
+				auto now = timer_service::clock::now();
+				tick = tick + interval > now ? tick + interval : now + interval;
+			}
+			else open = false;
+			if (latest) { co_yield std::move(*latest); latest.reset(); }
+		}
+	}
+
+	namespace detail
+	{
+		template<typename T>
+		basic_generator<std::vector<T>> _buffer_time(basic_generator<T> gen, timer_service::clock::duration window, std::size_t max_size)
+		{
+			auto it = _generator_access::pending_begin(gen);
+			std::vector<T> batch;
+			timer_service::clock::time_point batch_end;
+
+			for (bool open = it != gen.end(); open; )
+			{
+				next_result<T> r = co_await it.next_until(batch.empty() ? timer_service::clock::time_point::max() : batch_end);
+				if (r)
+				{
+					if (batch.empty()) batch_end = timer_service::clock::now() + window;
+					batch.push_back(std::move(*r.value));
+					if (batch.size() < max_size) continue;
+				}
+				else open = r.status != next_status::end;
+
+				if (!batch.empty()) { co_yield std::move(batch); batch.clear(); }
+			}
+		}
+	}
+
+	// returns a generator which yields the source values in batches - a batch is yielded once the given period has passed since its first value, or once it holds max_size values.
+	// empty batches are never yielded. when the source ends, the last batch (if any) is yielded right away.
+	// if max_size is zero, throws std::invalid_argument.
+	template<typename T, typename Rep, typename Period>
+	basic_generator<std::vector<T>> buffer_time(basic_generator<T> gen, std::chrono::duration<Rep, Period> period, std::size_t max_size)
+	{
+		if (max_size == 0) throw std::invalid_argument("buffer_time() batch size cannot be zero");
+		return detail::_buffer_time(std::move(gen), std::chrono::duration_cast<timer_service::clock::duration>(period), max_size);
+	}
+
+	// a record yielded by ndjson_records()
+	struct ndjson_record
+	{
+		std::string_view     text;                 // the record (without its line terminator)
+		const std::uint32_t *structurals = nullptr; // offsets into text of its structural characters ({ } [ ] : , outside strings, and unescaped quotes) in order
+		std::size_t          structural_count = 0;  // the number of offsets in structurals
+	};
+
+	namespace detail
+	{
+		// gets the index of the lowest set bit of x (x must not be 0)
+		inline unsigned _ctz64(std::uint64_t x)
+		{
+#if defined(_MSC_VER) && defined(_M_IX86)
+			// _BitScanForward64 is only available on 64-bit targets - scan the low half, then the high half
+			unsigned long i;
+			if (_BitScanForward(&i, (unsigned long)x)) return (unsigned)i;
+			_BitScanForward(&i, (unsigned long)(x >> 32));
+			return (unsigned)i + 32;
+#elif defined(_MSC_VER)
+			unsigned long i;
+			_BitScanForward64(&i, x);
+			return (unsigned)i;
+#else
+			return (unsigned)__builtin_ctzll(x);
+#endif
+		}
+
+		// gets a mask with bit i set iff block[i] == c for a 64-byte block - this compares 8 bytes at a time (SWAR) and assumes a little-endian target
+		inline std::uint64_t _eq_mask64(const char *block, char c)
+		{
+			constexpr std::uint64_t lo7 = 0x7f7f7f7f7f7f7f7full, ones = 0x0101010101010101ull;
+			std::uint64_t res = 0;
+			for (int w = 0; w < 8; ++w)
+			{
+				std::uint64_t x;
+				std::memcpy(&x, block + 8 * w, 8);
+				x ^= ones * (unsigned char)c;
+				std::uint64_t zero = ~(((x & lo7) + lo7) | x | lo7); // high bit set exactly in the zero bytes
+				res |= (((zero >> 7) * 0x0102040810204080ull) >> 56) << (8 * w); // gather the high bits (movemask)
+			}
+			return res;
+		}
+
+		// sets each bit to the xor of itself and all lower bits
+		inline std::uint64_t _prefix_xor(std::uint64_t x)
+		{
+			x ^= x << 1; x ^= x << 2; x ^= x << 4; x ^= x << 8; x ^= x << 16; x ^= x << 32;
+			return x;
+		}
+	}
+
+	// returns a generator which splits newline-delimited JSON into records, yielding each one with a tape of its structural offsets (so fields can be located without re-scanning).
+	// the input is classified 64 bytes at a time into bitmasks (quotes, backslashes, newlines, structurals), with escapes and string interiors resolved with bit operations, so newlines and structural characters inside strings are ignored.
+	// this is a scanner, not a validator - malformed JSON is split on a best-effort basis. empty lines are skipped and a trailing '\r' is stripped from each record.
+	// the yielded text refers to source, which must outlive the generator - the tape is reused, and is only valid until the generator advances.
+	inline generator<ndjson_record> ndjson_records(std::string_view source)
+	{
+		std::vector<std::uint32_t> tape;
+		std::uint64_t in_string = 0;   // all ones if the previous block ended inside a string
+		bool          escaped = false; // true if the first byte of the next block is escaped
+		std::size_t   start = 0;       // the start of the current record
+
+		char padded[64];
+		for (std::size_t base = 0; base < source.size(); base += 64)
+		{
+			const char *block = source.data() + base;
+			if (source.size() - base < 64)
+			{
+				std::memset(padded, 0, sizeof(padded));
+				std::memcpy(padded, block, source.size() - base);
+				block = padded;
+			}
+
+			// resolve escapes - backslash runs are rare, so walking them bit by bit is cheap
+			std::uint64_t backslash = detail::_eq_mask64(block, '\\'), escaped_mask = 0;
+			if (escaped) { escaped_mask = 1; backslash &= ~1ull; }
+			escaped = false;
+			while (backslash)
+			{
+				unsigned i = detail::_ctz64(backslash);
+				if (i == 63) escaped = true;
+				else { escaped_mask |= 2ull << i; backslash &= ~(2ull << i); }
+				backslash &= backslash - 1;
+			}
+
+			std::uint64_t quotes = detail::_eq_mask64(block, '"') & ~escaped_mask;
+			std::uint64_t inside = detail::_prefix_xor(quotes) ^ in_string; // set from an opening quote up to (excluding) its closing quote
+			in_string = (std::uint64_t)0 - (inside >> 63);
+
+			std::uint64_t newlines = detail::_eq_mask64(block, '\n') & ~inside;
+			std::uint64_t structurals = ((detail::_eq_mask64(block, '{') | detail::_eq_mask64(block, '}') | detail::_eq_mask64(block, '[') | detail::_eq_mask64(block, ']')
+				| detail::_eq_mask64(block, ':') | detail::_eq_mask64(block, ',')) & ~inside) | quotes;
+
+			for (std::uint64_t bits = newlines | structurals; bits; bits &= bits - 1)
+			{
+				unsigned i = detail::_ctz64(bits);
+				std::size_t pos = base + i;
+				if (newlines >> i & 1)
+				{
+					std::string_view text = source.substr(start, pos - start);
+					if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+					if (!text.empty()) co_yield ndjson_record{ text, tape.data(), tape.size() };
+
+					tape.clear();
+					start = pos + 1;
+				}
+				else tape.push_back((std::uint32_t)(pos - start));
+			}
+		}
+
+		std::string_view text = source.substr(std::min(start, source.size()));
+		if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+		if (!text.empty()) co_yield ndjson_record{ text, tape.data(), tape.size() };
+	}
+
+	// ------------- //
+
+	// -- senders -- //
+
+	// ------------- //
+
+	// coutil interoperates with sender/receiver (P2300-style) execution through member functions:
+	//     a sender has a completion_signatures typedef listing how it may complete and an rvalue connect(receiver) which returns an operation state.
+	//     an operation state has start(), which begins the operation without blocking - the receiver must eventually be completed exactly once.
+	//     a receiver has set_value(value...), set_error(error) and set_stopped() - these must not throw.
+
+	// completion tags - a completion signature is a function type such as set_value_t(int), set_error_t(std::exception_ptr) or set_stopped_t()
+	struct set_value_t {};
+	struct set_error_t {};
+	struct set_stopped_t {};
+
+	// the list of completion signatures of a sender - e.g. typedef completion_signatures<set_value_t(int), set_error_t(std::exception_ptr)> completion_signatures;
+	template<typename ...Sigs>
+	struct completion_signatures {};
+
+	namespace detail
+	{
+		// the type sent by the first set_value_t signature in a completion_signatures list (void if it sends nothing or there is none)
+		template<typename ...Sigs>
+		struct _sender_value { typedef void type; };
+		template<typename Sig, typename ...Rest>
+		struct _sender_value<Sig, Rest...> : _sender_value<Rest...> {};
+		template<typename ...Rest>
+		struct _sender_value<set_value_t(), Rest...> { typedef void type; };
+		template<typename V, typename ...Rest>
+		struct _sender_value<set_value_t(V), Rest...> { typedef V type; };
+		template<typename ...Sigs>
+		struct _sender_value<completion_signatures<Sigs...>> : _sender_value<Sigs...> {};
+
+		template<typename Sender>
+		using _sender_value_t = typename _sender_value<typename std::decay_t<Sender>::completion_signatures>::type;
+
+		// the set_value_t signature which sends a T (nothing if T is void)
+		template<typename T>
+		struct _value_signature { typedef set_value_t type(T); };
+		template<>
+		struct _value_signature<void> { typedef set_value_t type(); };
+	}
+
+	// task_sender adapts a basic_task into a sender - the operation state holds the coroutine itself (no additional coroutine frame is created).
+	// starting the operation resumes the coroutine on the calling thread until it completes or parks - if it parks, start() returns and whoever unparks it resumes it from there.
+	// the receiver is completed on the thread which finishes the coroutine, with set_value(result) on success or set_error(std::exception_ptr) if it ended due to exception.
+	template<typename T, typename InitialSuspend>
+	class task_sender
+	{
+	public: // -- sender interface -- //
+
+		typedef coutil::completion_signatures<typename detail::_value_signature<T>::type, set_error_t(std::exception_ptr)> completion_signatures;
+
+		template<typename Receiver>
+		class operation
+		{
+		private: // -- private utility info -- //
+
+			// the wake link attached to the coroutine while the operation drives it
+			struct link_t : detail::_wake_link { operation *op; };
+
+		private: // -- data -- //
+
+			basic_task<T, InitialSuspend> task;
+			Receiver                      receiver;
+			link_t                        link;
+
+		private: // -- private util -- //
+
+			// completes the receiver with the outcome of the (completed) task
+			void _complete() noexcept
+			{
+				try
+				{
+					if constexpr (std::is_void_v<T>) { task.wait(); receiver.set_value(); }
+					else receiver.set_value(task.wait());
+				}
+				catch (...) { receiver.set_error(std::current_exception()); }
+			}
+
+			// resumes the coroutine until it completes (then completes the receiver) or parks.
+			// a parked coroutine is driven on by whichever of this and its unparker comes second.
+			void _drive() noexcept
+			{
+				auto &s = task.co.promise();
+				for (;;)
+				{
+					if (!task.co.done()) detail::_resume(task.co);
+					if (task.co.done()) return _complete();
+					if (s.is_parked())
+					{
+						if (s.hook.handoff.fetch_add(1, std::memory_order_acq_rel) == 0) return; // the unparker drives it on
+						s.hook.handoff.store(0, std::memory_order_relaxed);
+						s.parked.store(0, std::memory_order_relaxed);
+					}
+				}
+			}
+
+			static void _notify(detail::_wake_link &l, detail::_park_state &s)
+			{
+				if (s.hook.handoff.fetch_add(1, std::memory_order_acq_rel) == 0) return; // start() (or a previous unparker) is still driving it and will see the unpark
+				s.hook.handoff.store(0, std::memory_order_relaxed);
+				s.parked.store(0, std::memory_order_relaxed);
+				static_cast<link_t&>(l).op->_drive();
+			}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			template<typename R>
+			operation(basic_task<T, InitialSuspend> &&t, R &&r) : task(std::move(t)), receiver(std::forward<R>(r))
+			{
+				link.notify = &_notify;
+				link.op = this;
+			}
+
+			operation(const operation&) = delete;
+			operation &operator=(const operation&) = delete;
+
+		public: // -- operation interface -- //
+
+			// starts driving the coroutine (see task_sender) - the operation state must stay alive until the receiver is completed
+			void start() noexcept
+			{
+				if (task.empty()) return receiver.set_error(std::make_exception_ptr(bad_coroutine_access("Accessing empty couroutine manager")));
+				task.co.promise().link = &link;
+				_drive();
+			}
+		};
+
+	private: // -- data -- //
+
+		basic_task<T, InitialSuspend> task;
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// steals the handle of the given basic_task - task is left in the empty state.
+		// the coroutine must not currently be parked.
+		explicit task_sender(basic_task<T, InitialSuspend> &&t) : task(std::move(t)) {}
+
+	public: // -- sender interface -- //
+
+		// connects the stored coroutine to a receiver - after this operation the task_sender is empty.
+		// if the task_sender is empty, the operation completes with set_error(bad_coroutine_access).
+		template<typename Receiver>
+		operation<std::decay_t<Receiver>> connect(Receiver &&r) && { return { std::move(task), std::forward<Receiver>(r) }; }
+	};
+
+	// adapts a basic_task into a sender (see task_sender).
+	template<typename T, typename InitialSuspend>
+	task_sender<T, InitialSuspend> as_sender(basic_task<T, InitialSuspend> &&task) { return task_sender<T, InitialSuspend>{ std::move(task) }; }
+
+	// sender_awaitable adapts a sender into an awaitable object (see as_awaitable()).
+	// the operation state is stored directly in the awaitable (i.e. in the awaiting coroutine's frame), so no allocation is performed.
+	// the awaiting coroutine is parked until the operation completes (it is not resumed on the completing thread).
+	// set_value(value) - co_await yields the value.
+	// set_error(error) - co_await rethrows the error (if error is not an std::exception_ptr, it is thrown as-is).
+	// set_stopped()    - co_await throws operation_stopped.
+	template<typename Sender>
+	class sender_awaitable
+	{
+	private: // -- private utility info -- //
+
+		typedef detail::_sender_value_t<Sender> value_type;
+
+		struct receiver
+		{
+			sender_awaitable *self;
+
+			template<typename ...Args>
+			void set_value(Args &&...args) noexcept
+			{
+				self->result.set_value(std::forward<Args>(args)...);
+				self->parker.unpark();
+			}
+			template<typename E>
+			void set_error(E &&e) noexcept
+			{
+				if constexpr (std::is_same_v<std::decay_t<E>, std::exception_ptr>) self->result.set_exception(std::forward<E>(e));
+				else self->result.set_exception(std::make_exception_ptr(std::forward<E>(e)));
+				self->parker.unpark();
+			}
+			void set_stopped() noexcept
+			{
+				self->stopped = true;
+				self->parker.unpark();
+			}
+		};
+
+		typedef decltype(std::declval<Sender>().connect(std::declval<receiver>())) operation_t;
+
+	private: // -- data -- //
+
+		detail::_async_result<value_type> result;          // the value or error completion result
+		bool                              stopped = false; // marks a set_stopped() completion
+		detail::_parker                   parker;          // parks the awaiting coroutine until completion
+		operation_t                       op;              // the connected operation state
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// connects the sender to this awaitable - the operation is not started until awaited.
+		explicit sender_awaitable(Sender &&s) : op(std::forward<Sender>(s).connect(receiver{ this })) {}
+
+		sender_awaitable(const sender_awaitable&) = delete;
+		sender_awaitable &operator=(const sender_awaitable&) = delete;
+
+	public: // -- await interface -- //
+
+		bool await_ready() { return false; }
+		template<typename P>
+		COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+		{
+			parker.park(h, COUTIL_SITE(), metrics::primitive::sender);
+			op.start();
+			return parker.parked(); // if it completed synchronously, don't suspend at all
+		}
+		value_type await_resume()
+		{
+			if (stopped) throw operation_stopped("Awaited sender completed with set_stopped()");
+			return result.get();
+		}
+	};
+
+	// adapts a sender into an awaitable object (see sender_awaitable) - e.g. co_await as_awaitable(sender).
+	template<typename Sender>
+	sender_awaitable<Sender> as_awaitable(Sender &&s) { return sender_awaitable<Sender>(std::forward<Sender>(s)); }
+
+	// --------------- //
+
+	// -- executors -- //
+
+	// --------------- //
+
+	// thread_pool is an executor which drives coroutines on a fixed set of worker threads.
+	// scheduling a task transfers ownership of the coroutine to the pool, which resumes it until completion and then destroys it (the result is discarded).
+	// coroutines are linked into the run queue through a hook in their promise, so scheduling never allocates.
+	// a batch of coroutines is linked into a chain up front and published with a single atomic operation, after which idle workers are woken in one go.
+	// if a pool coroutine parks (e.g. awaiting a sender) it is rescheduled on the pool once unparked.
+	// if it suspends without parking (e.g. awaiting a lazy_task), it is put back in the run queue to be resumed again later.
+	class thread_pool
+	{
+	private: // -- private utility info -- //
+
+		typedef detail::_park_state state_t;
+
+		// the wake link attached to each coroutine owned by the pool
+		struct link_t : detail::_wake_link { thread_pool *pool; };
+
+	private: // -- data -- //
+
+		std::atomic<state_t*>    inbox{ nullptr };   // coroutines published by schedulers (LIFO chain)
+		state_t                 *queue = nullptr;    // coroutines taken from the inbox by a worker (FIFO chain) - guarded by mutex
+		state_t                **queue_tail = &queue;
+
+		std::atomic<std::size_t> idle{ 0 };          // number of workers sleeping on cv
+		std::atomic<std::size_t> live{ 0 };          // number of scheduled coroutines which have not yet completed
+		bool                     stopping = false;   // guarded by mutex
+		std::exception_ptr       ex;                 // the first exception thrown by a pool coroutine - guarded by mutex
+
+		std::mutex               mutex;
+		std::condition_variable  cv;                 // signalled when work arrives or the pool is stopping
+		std::condition_variable  done_cv;            // signalled when live drops to zero
+
+		link_t                   link;
+		std::vector<std::thread> workers;
+
+	private: // -- private util -- //
+
+		// publishes a chain of n coroutines (linked from last to first via hook.next) and wakes up to n idle workers
+		void _publish(state_t *last, state_t *first, std::size_t n)
+		{
+			state_t *head = inbox.load(std::memory_order_relaxed);
+			do first->hook.next = head;
+			while (!inbox.compare_exchange_weak(head, last, std::memory_order_seq_cst, std::memory_order_relaxed));
+			detail::_metric_add(metrics::metric::pool_queued, (std::int64_t)n);
+
+			if (std::size_t i = idle.load(std::memory_order_seq_cst))
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (n >= i) cv.notify_all();
+				else while (n--) cv.notify_one();
+			}
+		}
+		void _reschedule(state_t &s)
+		{
+			s.hook.handoff.store(0, std::memory_order_relaxed);
+			s.parked.store(0, std::memory_order_relaxed);
+			_publish(&s, &s, 1);
+		}
+
+		// drops a reference to the pool's outstanding work, waking up anyone waiting for it to finish
+		void _release()
+		{
+			if (live.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				done_cv.notify_all();
+			}
+		}
+
+		static void _notify(detail::_wake_link &l, state_t &s)
+		{
+#ifdef COUTIL_TRACE
+			// recorded whichever side completes the handoff (once it is done, the coroutine may already be running again or even destroyed)
+			trace::recorder &rec = trace::recorder::global();
+			rec.record({ rec.now(), s.hook.trace_id, 0, trace::event_kind::wake, (std::uint8_t)(_on_worker() ? trace::wake_source::worker : trace::wake_source::external) });
+#endif
+			if (s.hook.handoff.fetch_add(1, std::memory_order_acq_rel) == 1)
+			{
+				// this runs on an arbitrary thread - hold a reference so the pool outlives the publish even if the coroutine completes right away
+				thread_pool &pool = *static_cast<link_t&>(l).pool;
+				pool.live.fetch_add(1, std::memory_order_relaxed);
+				pool._reschedule(s);
+				pool._release();
+			}
+		}
+
+		// takes the next coroutine to run - blocks until one is available, or returns null if the pool is stopping
+		state_t *_pop()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;)
+			{
+				// move everything published so far into the (FIFO) queue
+				if (!queue)
+				{
+					state_t *rev = nullptr;
+					for (state_t *s = inbox.exchange(nullptr, std::memory_order_acquire); s; )
+					{
+						state_t *next = s->hook.next;
+						s->hook.next = rev;
+						rev = s;
+						s = next;
+					}
+					*queue_tail = rev;
+					for (; rev; rev = rev->hook.next) queue_tail = &rev->hook.next;
+				}
+				if (state_t *s = queue)
+				{
+					if (!(queue = s->hook.next)) queue_tail = &queue;
+					detail::_metric_add(metrics::metric::pool_queued, -1);
+					return s;
+				}
+				if (stopping) return nullptr;
+
+				idle.fetch_add(1, std::memory_order_seq_cst);
+				cv.wait(lock, [this] { return inbox.load(std::memory_order_seq_cst) || stopping; });
+				idle.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		// resumes a coroutine and routes it according to how it suspended
+		void _run(state_t &s)
+		{
+			auto h = s.hook.self;
+#ifdef COUTIL_TRACE
+			trace::recorder &rec = trace::recorder::global();
+			std::uint64_t start = rec.now();
+#endif
+			if (!h.done()) detail::_resume(h, s);
+#ifdef COUTIL_TRACE
+			trace::run_outcome outcome = h.done() ? trace::run_outcome::done : s.is_parked() ? trace::run_outcome::parked : trace::run_outcome::yielded;
+			rec.record({ start, s.hook.trace_id, rec.now() - start, trace::event_kind::run, (std::uint8_t)outcome });
+#endif
+
+			if (h.done())
+			{
+				try { s.hook.finish(h); }
+				catch (...) { std::lock_guard<std::mutex> lock(mutex); if (!ex) ex = std::current_exception(); }
+
+				_release();
+			}
+			else if (s.is_parked()) { if (s.hook.handoff.fetch_add(1, std::memory_order_acq_rel) == 1) _reschedule(s); }
+			else _publish(&s, &s, 1);
+		}
+
+#ifdef COUTIL_TRACE
+		// true on pool worker threads (used to attribute wakeups)
+		static bool &_on_worker() { thread_local bool on = false; return on; }
+
+		void _work() { _on_worker() = true; while (state_t *s = _pop()) _run(*s); }
+#else
+		void _work() { while (state_t *s = _pop()) _run(*s); }
+#endif
+
+		// prepares a task for the pool (taking ownership of it) and returns its state - the task must not be empty or parked
+		template<typename T, typename InitialSuspend>
+		state_t &_adopt(basic_task<T, InitialSuspend> &task)
+		{
+			typedef basic_task<T, InitialSuspend> task_t;
+			if (task.empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+
+			typename task_t::handle h = std::exchange(task.co, nullptr);
+			state_t &s = h.promise();
+			s.link = &link;
+			s.hook.self = h;
+			s.hook.finish = [](std::experimental::coroutine_handle<> h) { task_t{ task_t::handle::from_address(h.address()) }.wait(); };
+			live.fetch_add(1, std::memory_order_relaxed);
+			detail::_metric_add(metrics::metric::pool_scheduled);
+#ifdef COUTIL_TRACE
+			trace::recorder &rec = trace::recorder::global();
+			s.hook.trace_id = rec.new_id();
+			rec.record({ rec.now(), s.hook.trace_id, 0, trace::event_kind::spawn, 0 });
+#endif
+			return s;
+		}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// creates a pool with the given number of worker threads (at least 1)
+		explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency())
+		{
+			link.notify = &_notify;
+			link.pool = this;
+
+			if (threads == 0) threads = 1;
+			workers.reserve(threads);
+			for (std::size_t i = 0; i < threads; ++i) workers.emplace_back([this] { _work(); });
+		}
+
+		// waits for all scheduled coroutines to complete (exceptions are discarded) and then stops the worker threads
+		~thread_pool()
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				done_cv.wait(lock, [this] { return live.load(std::memory_order_acquire) == 0; });
+				stopping = true;
+			}
+			cv.notify_all();
+			for (std::thread &t : workers) t.join();
+		}
+
+		thread_pool(const thread_pool&) = delete;
+		thread_pool &operator=(const thread_pool&) = delete;
+
+	public: // -- scheduling -- //
+
+		// transfers ownership of the task to the pool and schedules it for execution (the task must not currently be parked).
+		// if the task is empty, throws bad_coroutine_access.
+		template<typename T, typename InitialSuspend>
+		void schedule(basic_task<T, InitialSuspend> &&task)
+		{
+			state_t &s = _adopt(task);
+			_publish(&s, &s, 1);
+		}
+
+		// transfers ownership of each task in [first, last) to the pool and schedules them for execution as a single batch (see schedule()).
+		// the tasks are left in the empty state.
+		// if any task is empty, throws bad_coroutine_access and nothing is scheduled.
+		template<typename Iter>
+		void schedule_bulk(Iter first, Iter last)
+		{
+			for (Iter i = first; i != last; ++i) if (i->empty()) throw bad_coroutine_access("Accessing empty couroutine manager");
+
+			state_t *head = nullptr, *tail = nullptr;
+			std::size_t n = 0;
+			for (; first != last; ++first, ++n)
+			{
+				state_t &s = _adopt(*first);
+				s.hook.next = head;
+				head = &s;
+				if (!tail) tail = &s;
+			}
+			if (n) _publish(head, tail, n);
+		}
+
+		// returns the number of worker threads
+		std::size_t size() const noexcept { return workers.size(); }
+
+		// blocks until all coroutines scheduled on the pool have completed.
+		// if any of them ended due to exception, rethrows the first such exception (and clears it).
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done_cv.wait(lock, [this] { return live.load(std::memory_order_acquire) == 0; });
+			if (ex) std::rethrow_exception(std::exchange(ex, nullptr));
+		}
+	};
+
+	// blocking_pool is an elastic set of threads for running blocking calls (see offload()) away from the threads driving coroutines.
+	// a thread is started whenever a job arrives and no idle thread is available (up to a maximum) - idle threads exit after a keep-alive period.
+	class blocking_pool
+	{
+	public: // -- job interface -- //
+
+		// an (intrusive) unit of work for the pool - run is invoked on a pool thread with the job itself
+		struct job
+		{
+			job  *next = nullptr;
+			void (*run)(job&) = nullptr;
+		};
+
+	private: // -- data -- //
+
+		std::mutex                               mutex;
+		std::condition_variable                  cv;      // signalled when a job arrives or the pool is stopping
+		std::condition_variable                  exit_cv; // signalled when a thread exits
+
+		job                                     *head = nullptr; // FIFO queue of pending jobs
+		job                                    **tail = &head;
+		std::size_t                              queued = 0;     // number of pending jobs
+		std::size_t                              threads = 0;    // number of running threads
+		std::size_t                              idle = 0;       // number of threads waiting for jobs
+		bool                                     stopping = false;
+
+		const std::size_t                        max_threads;
+		const std::chrono::steady_clock::duration keep_alive;
+
+	private: // -- private util -- //
+
+		void _work()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			for (;;)
+			{
+				if (job *j = head)
+				{
+					if (!(head = j->next)) tail = &head;
+					--queued;
+					detail::_metric_add(metrics::metric::blocking_queued, -1);
+					detail::_metric_add(metrics::metric::blocking_jobs);
+
+					lock.unlock();
+					j->run(*j);
+					lock.lock();
+				}
+				else if (stopping) break;
+				else
+				{
+					++idle;
+					bool woken = cv.wait_for(lock, keep_alive, [this] { return head || stopping; });
+					--idle;
+					if (!woken) break;
+				}
+			}
+
+			// the lock is held until we return, so the pool cannot be destroyed while this thread still refers to it
+			--threads;
+			exit_cv.notify_all();
+		}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// creates an (initially empty) pool which runs at most max_threads (at least 1) threads at a time
+		explicit blocking_pool(std::size_t max_threads = 256, std::chrono::steady_clock::duration keep_alive = std::chrono::seconds(10))
+			: max_threads(max_threads ? max_threads : 1), keep_alive(keep_alive)
+		{}
+
+		// runs all pending jobs and waits for every pool thread to exit
+		~blocking_pool()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stopping = true;
+			cv.notify_all();
+			exit_cv.wait(lock, [this] { return threads == 0; });
+		}
+
+		blocking_pool(const blocking_pool&) = delete;
+		blocking_pool &operator=(const blocking_pool&) = delete;
+
+		// gets the pool used by default for offload()
+		static blocking_pool &global()
+		{
+			static blocking_pool pool;
+			return pool;
+		}
+
+	public: // -- interface -- //
+
+		// queues a job to run on a pool thread - the job object must remain valid until its run function is invoked.
+		void submit(job &j)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			j.next = nullptr;
+			*tail = &j;
+			tail = &j.next;
+
+			// start a new thread if there are more pending jobs than idle threads to take them
+			detail::_metric_add(metrics::metric::blocking_queued);
+			if (++queued > idle && threads < max_threads)
+			{
+				++threads;
+				std::thread([this] { _work(); }).detach();
+			}
+			else cv.notify_one();
+		}
+	};
+
+	// offload_awaitable runs a callable on a blocking_pool thread while the awaiting coroutine is parked (see offload()).
+	// the coroutine is resumed by its own driver (e.g. the thread waiting on it, or the thread_pool it was scheduled on) - never on the pool thread.
+	template<typename F>
+	class offload_awaitable : private blocking_pool::job
+	{
+	private: // -- private utility info -- //
+
+		typedef std::invoke_result_t<F&> result_type;
+
+		static void _run(blocking_pool::job &j)
+		{
+			offload_awaitable &self = static_cast<offload_awaitable&>(j);
+			self.result.set_from(self.fn);
+			self.parker.unpark();
+		}
+
+	private: // -- data -- //
+
+		blocking_pool                     &pool;
+		F                                  fn;
+		detail::_async_result<result_type> result;
+		detail::_parker                    parker;
+
+	public: // -- ctor / dtor / asgn -- //
+
+		template<typename U>
+		offload_awaitable(blocking_pool &p, U &&f) : pool(p), fn(std::forward<U>(f)) { run = &_run; }
+
+		offload_awaitable(const offload_awaitable&) = delete;
+		offload_awaitable &operator=(const offload_awaitable&) = delete;
+
+	public: // -- await interface -- //
+
+		bool await_ready() { return false; }
+		template<typename P>
+		COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+		{
+			parker.park(h, COUTIL_SITE(), metrics::primitive::offload);
+			pool.submit(*this);
+			return parker.parked();
+		}
+		result_type await_resume() { return result.get(); }
+	};
+
+	// runs f() on a thread of the given blocking pool and yields its result (or rethrows its exception) - e.g. co_await offload(pool, f).
+	// the awaiting coroutine does not occupy the thread driving it while f runs.
+	template<typename F>
+	offload_awaitable<std::decay_t<F>> offload(blocking_pool &pool, F &&f) { return offload_awaitable<std::decay_t<F>>(pool, std::forward<F>(f)); }
+	// equivalent to offload(blocking_pool::global(), f).
+	template<typename F>
+	offload_awaitable<std::decay_t<F>> offload(F &&f) { return offload(blocking_pool::global(), std::forward<F>(f)); }
+
+	// worker_group runs jobs on a fixed set of long-lived coroutines scheduled on a thread_pool - each worker loops taking the next job from a queue and running it inline.
+	// submitting a job is a queue push (or a direct handoff to an idle worker) - no coroutine frame is created per job, so tiny jobs cost little more than a call.
+	// Job is a callable taking no arguments. if it returns an awaitable (e.g. a sender_awaitable or a oneshot receiver), the worker co_awaits it in its own frame,
+	// so a job can suspend (the worker parks, freeing its thread) without needing a frame of its own. the awaited result (if any) is discarded.
+	// exceptions thrown by jobs are collected - the first is rethrown by close().
+	template<typename Job = std::function<void()>>
+	class worker_group
+	{
+	private: // -- private utility info -- //
+
+		typedef std::invoke_result_t<Job&> result_type;
+
+		// an idle worker - stored in its next-job awaitable
+		struct waiter
+		{
+			waiter             *next = nullptr;
+			std::optional<Job>  job;    // the job handed to the worker (empty if the group is closing)
+			detail::_parker     parker;
+		};
+
+		// awaitable which takes the next job, parking the worker until one is submitted - yields an empty job if the group is closed and drained
+		class next_awaitable : private waiter
+		{
+		private: // -- data -- //
+
+			worker_group &g;
+
+		public: // -- ctor / dtor / asgn -- //
+
+			explicit next_awaitable(worker_group &_g) : g(_g) {}
+
+			next_awaitable(const next_awaitable&) = delete;
+			next_awaitable &operator=(const next_awaitable&) = delete;
+
+		public: // -- await interface -- //
+
+			bool await_ready() { return false; }
+			template<typename P>
+			COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+			{
+				std::lock_guard<std::mutex> lock(g.mutex);
+				if (!g.jobs.empty())
+				{
+					this->job.emplace(std::move(g.jobs.front()));
+					g.jobs.pop_front();
+					return false;
+				}
+				if (g.closed) return false;
+
+				this->parker.park(h, COUTIL_SITE(), metrics::primitive::worker_group);
+				this->next = std::exchange(g.idle, static_cast<waiter*>(this));
+				return true;
+			}
+			std::optional<Job> await_resume() { return std::move(this->job); }
+		};
+
+	private: // -- data -- //
+
+		std::mutex              mutex;          // guards the fields below
+		std::condition_variable exited_cv;      // signalled when the last worker exits
+		std::deque<Job>         jobs;           // jobs waiting for a worker
+		waiter                 *idle = nullptr; // parked workers (LIFO - the most recently active worker is the warmest)
+		std::size_t             live = 0;       // workers which have not exited
+		bool                    closed = false;
+		std::exception_ptr      ex;             // the first exception thrown by a job
+
+	private: // -- private util -- //
+
+		static lazy_task<> _work(worker_group *g)
+		{
+			while (std::optional<Job> job = co_await next_awaitable{ *g })
+			{
+				try
+				{
+					if constexpr (std::is_void_v<result_type>) (*job)();
+					else co_await (*job)();
+				}
+				catch (...) { std::lock_guard<std::mutex> lock(g->mutex); if (!g->ex) g->ex = std::current_exception(); }
+			}
+
+			// this must be the last access to the group - it may be destroyed as soon as the lock is released
+			std::lock_guard<std::mutex> lock(g->mutex);
+			if (--g->live == 0) g->exited_cv.notify_all();
+		}
+
+		// closes the group and waits for the workers to exit
+		void _shutdown()
+		{
+			waiter *w;
+			std::unique_lock<std::mutex> lock(mutex);
+			closed = true;
+			w = std::exchange(idle, nullptr);
+			lock.unlock();
+
+			while (w) std::exchange(w, w->next)->parker.unpark(); // next must be read before unparking
+
+			lock.lock();
+			exited_cv.wait(lock, [this] { return live == 0; });
+		}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// starts the given number of workers (at least 1) on pool - by default, one per pool thread
+		explicit worker_group(thread_pool &pool, std::size_t workers = 0)
+		{
+			if (workers == 0) workers = pool.size();
+			std::vector<lazy_task<>> tasks;
+			tasks.reserve(workers);
+			for (std::size_t i = 0; i < workers; ++i) tasks.push_back(_work(this));
+
+			live = workers;
+			pool.schedule_bulk(tasks.begin(), tasks.end());
+		}
+
+		// closes the group (see close()) - exceptions from jobs are discarded
+		~worker_group() { _shutdown(); }
+
+		worker_group(const worker_group&) = delete;
+		worker_group &operator=(const worker_group&) = delete;
+
+	public: // -- interface -- //
+
+		// queues a job - it is handed straight to an idle worker if there is one.
+		// if the group is closed, throws std::invalid_argument.
+		void submit(Job job)
+		{
+			waiter *w;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (closed) throw std::invalid_argument("Attempt to submit a job to a closed worker_group");
+				if (!(w = idle)) { jobs.push_back(std::move(job)); return; }
+
+				idle = w->next;
+				w->job.emplace(std::move(job));
+			}
+			w->parker.unpark();
+		}
+
+		// stops accepting jobs and blocks until the workers have run all queued jobs and exited.
+		// if any job threw, rethrows the first such exception (and clears it).
+		// this must not be called from a thread of the pool the workers run on.
+		void close()
+		{
+			_shutdown();
+			std::lock_guard<std::mutex> lock(mutex);
+			if (ex) std::rethrow_exception(std::exchange(ex, nullptr));
+		}
+	};
+
+#ifdef COUTIL_FRAME_BUDGET
+	// ------------------ //
+
+	// -- frame budgets -- //
+
+	// ------------------ //
+
+	// if COUTIL_FRAME_BUDGET is defined, every coroutine frame records the frame_budget it is charged to (if any), so a group of coroutines can be held to a memory limit.
+	// frame_budget bounds the live frame bytes of a group - coroutines spawned through spawn() are charged to it, as are all coroutines they create (transitively).
+	// spawn() suspends the spawner while the group is over its limit, and waiting spawners are admitted in FIFO order as the group's frames are freed,
+	// so under overload memory stays bounded instead of frames being created faster than they finish.
+	// the limit is soft - admitted coroutines never wait to create frames, so the group can exceed it by the frames of the coroutines already in flight.
+	class frame_budget
+	{
+	private: // -- private utility info -- //
+
+		// a spawner waiting for admission - stored in the awaitable
+		struct waiter
+		{
+			waiter         *next = nullptr;
+			detail::_parker parker;
+		};
+
+		friend void detail::_charge_frame(frame_budget&, std::size_t);
+		friend void detail::_free_frame(frame_budget&, std::size_t);
+
+	private: // -- data -- //
+
+		const std::size_t        limit_bytes;
+		std::atomic<std::size_t> live_bytes{ 0 };
+		std::atomic<std::size_t> waiting{ 0 }; // the number of queued spawners
+
+		std::mutex mutex;          // guards the queue
+		waiter    *head = nullptr;
+		waiter   **tail = &head;
+
+	private: // -- private util -- //
+
+		void _enqueue(waiter &w)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			w.next = nullptr;
+			*tail = &w;
+			tail = &w.next;
+			waiting.fetch_add(1, std::memory_order_seq_cst);
+		}
+
+		// admits the first waiting spawner if the group is under its limit - each admitted spawner admits the next after spawning (if the group is still under)
+		void _admit()
+		{
+			if (waiting.load(std::memory_order_seq_cst) == 0) return; // pairs with the increment in _enqueue() - either side sees the other
+
+			waiter *w;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!(w = head) || live_bytes.load(std::memory_order_seq_cst) >= limit_bytes) return;
+				if (!(head = w->next)) tail = &head;
+				waiting.fetch_sub(1, std::memory_order_relaxed);
+			}
+			w->parker.unpark();
+		}
+
+	public: // -- awaitables -- //
+
+		// awaitable which waits for admission and then creates a coroutine with factory() charged to the budget and schedules it (see spawn())
+		template<typename F>
+		class spawn_awaitable : private waiter
+		{
+		private: // -- data -- //
+
+			frame_budget &budget;
+			thread_pool  &pool;
+			F             factory;
+
+		public: // -- ctor / dtor / asgn -- //
+
+			template<typename U>
+			spawn_awaitable(frame_budget &b, thread_pool &p, U &&f) : budget(b), pool(p), factory(std::forward<U>(f)) {}
+
+			spawn_awaitable(const spawn_awaitable&) = delete;
+			spawn_awaitable &operator=(const spawn_awaitable&) = delete;
+
+		public: // -- await interface -- //
+
+			// spawners queue behind earlier ones even if the group is under its limit
+			bool await_ready() const { return budget.waiting.load(std::memory_order_seq_cst) == 0 && budget.live() < budget.limit(); }
+			template<typename P>
+			COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+			{
+				this->parker.park(h, COUTIL_SITE(), metrics::primitive::frame_budget);
+				budget._enqueue(*this);
+				budget._admit(); // frames may have been freed before we were queued
+				return this->parker.parked();
+			}
+			void await_resume()
+			{
+				struct _next { frame_budget &b; ~_next() { b._admit(); } } next{ budget };
+
+				detail::_budget_scope scope(&budget);
+				pool.schedule(factory());
+			}
+		};
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// creates a budget which admits spawns while the group's live frame bytes are below limit
+		explicit frame_budget(std::size_t limit) : limit_bytes(limit) {}
+
+		// all frames charged to the budget must have been freed
+		~frame_budget() = default;
+
+		frame_budget(const frame_budget&) = delete;
+		frame_budget &operator=(const frame_budget&) = delete;
+
+	public: // -- interface -- //
+
+		// returns the limit on the live frame bytes of the group
+		std::size_t limit() const noexcept { return limit_bytes; }
+		// returns the live frame bytes charged to the budget
+		std::size_t live() const noexcept { return live_bytes.load(std::memory_order_relaxed); }
+
+		// returns an awaitable which waits until the group is admitted under its limit, then calls factory() (which must return a task) and schedules the task on pool - e.g. co_await budget.spawn(pool, [&] { return handle(req); }).
+		// the frames created by factory() and by the task while it runs are charged to the budget. if factory() throws, the exception is propagated and nothing is scheduled.
+		template<typename F>
+		spawn_awaitable<std::decay_t<F>> spawn(thread_pool &pool, F &&factory) { return { *this, pool, std::forward<F>(factory) }; }
+	};
+
+	namespace detail
+	{
+		inline void _charge_frame(frame_budget &budget, std::size_t size) { budget.live_bytes.fetch_add(size, std::memory_order_relaxed); }
+		inline void _free_frame(frame_budget &budget, std::size_t size)
+		{
+			budget.live_bytes.fetch_sub(size, std::memory_order_seq_cst);
+			budget._admit();
+		}
+	}
+#endif
+
+	// ------------------------- //
+
+	// -- parallel algorithms -- //
+
+	// ------------------------- //
+
+	namespace detail
+	{
+		// base of the parallel algorithm awaitables - the awaiting coroutine parks while the algorithm runs as phases of chunk coroutines on a thread_pool.
+		// Derived provides std::size_t _start() (the number of chunks in the first phase), void _chunk(i) and std::size_t _next_phase() (the number of chunks in the next phase, or 0 when finished).
+		// a chunk which finishes asynchronously is written as bool _chunk(i) instead - it returns false if it is still running, and then calls _chunk_done() (after _chunk_failed(), if it failed) once it finishes.
+		// the last chunk of a phase starts the next one (or unparks the awaiter), so no thread ever blocks waiting for a phase.
+		template<typename Derived>
+		class _parallel_awaitable
+		{
+		private: // -- data -- //
+
+			std::atomic<std::size_t> pending{ 0 };
+			std::atomic<bool>        failed{ false };
+			std::exception_ptr       ex;     // the first exception thrown by a chunk
+			_parker                  parker;
+
+		protected: // -- data -- //
+
+			thread_pool &pool;
+
+		private: // -- private util -- //
+
+			static lazy_task<> _run_chunk(_parallel_awaitable *self, std::size_t i)
+			{
+				Derived &d = *static_cast<Derived*>(self);
+				bool done = true;
+				try
+				{
+					if constexpr (std::is_void_v<decltype(d._chunk(i))>) d._chunk(i);
+					else done = d._chunk(i);
+				}
+				catch (...) { self->_chunk_failed(std::current_exception()); }
+
+				if (done) self->_chunk_done();
+				co_return;
+			}
+
+			void _fork(std::size_t n)
+			{
+				pending.store(n, std::memory_order_relaxed);
+				std::vector<lazy_task<>> chunks;
+				chunks.reserve(n);
+				for (std::size_t i = 0; i < n; ++i) chunks.push_back(_run_chunk(this, i));
+				pool.schedule_bulk(chunks.begin(), chunks.end());
+			}
+
+			void _phase_done()
+			{
+				std::size_t n = failed.load(std::memory_order_relaxed) ? 0 : static_cast<Derived*>(this)->_next_phase();
+				if (n) _fork(n);
+				else parker.unpark();
+			}
+
+		protected: // -- ctor / dtor / asgn -- //
+
+			explicit _parallel_awaitable(thread_pool &p) : pool(p) {}
+
+			_parallel_awaitable(const _parallel_awaitable&) = delete;
+			_parallel_awaitable &operator=(const _parallel_awaitable&) = delete;
+
+			// returns a chunk count for n elements - a few chunks per worker (to absorb imbalance) but never fewer than min_grain elements per chunk
+			std::size_t _chunks_for(std::size_t n, std::size_t min_grain = 1) const
+			{
+				std::size_t by_grain = n / (min_grain ? min_grain : 1);
+				return std::max<std::size_t>(1, std::min({ n, pool.size() * 4, by_grain }));
+			}
+
+			// rethrows the exception of the failed chunk (if any)
+			void _rethrow() { if (ex) std::rethrow_exception(ex); }
+
+			// records the failure of a chunk - only the first exception is kept, and no further phases are started
+			void _chunk_failed(std::exception_ptr e) { if (!failed.exchange(true, std::memory_order_relaxed)) ex = std::move(e); }
+			// marks a chunk as finished - the last one of a phase starts the next phase (or unparks the awaiter)
+			void _chunk_done() { if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) _phase_done(); }
+
+		public: // -- await interface -- //
+
+			bool await_ready() { return false; }
+			template<typename P>
+			COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+			{
+				parker.park(h, COUTIL_SITE(), metrics::primitive::parallel);
+				if (std::size_t n = static_cast<Derived*>(this)->_start()) _fork(n);
+				else parker.unpark();
+				return parker.parked();
+			}
+		};
+
+		// the boundary of chunk i of count over n elements
+		inline std::size_t _chunk_bound(std::size_t n, std::size_t count, std::size_t i) { return n / count * i + std::min(i, n % count); }
+	}
+
+	// awaitable for parallel_transform()
+	template<typename InIt, typename OutIt, typename F>
+	class parallel_transform_awaitable : public detail::_parallel_awaitable<parallel_transform_awaitable<InIt, OutIt, F>>
+	{
+	private: // -- private utility info -- //
+
+		typedef detail::_parallel_awaitable<parallel_transform_awaitable> base;
+		friend base;
+
+	private: // -- data -- //
+
+		InIt        first;
+		OutIt       out;
+		F           f;
+		std::size_t n, chunks = 0;
+
+	private: // -- phases -- //
+
+		std::size_t _start() { return n ? chunks = this->_chunks_for(n) : 0; }
+		void _chunk(std::size_t i)
+		{
+			std::size_t b = detail::_chunk_bound(n, chunks, i), e = detail::_chunk_bound(n, chunks, i + 1);
+			std::transform(first + b, first + e, out + b, f);
+		}
+		std::size_t _next_phase() { return 0; }
+
+	public: // -- ctor / dtor / asgn -- //
+
+		template<typename U>
+		parallel_transform_awaitable(thread_pool &p, InIt _first, InIt last, OutIt _out, U &&_f) : base(p), first(_first), out(_out), f(std::forward<U>(_f)), n((std::size_t)(last - _first)) {}
+
+	public: // -- await interface -- //
+
+		OutIt await_resume() { this->_rethrow(); return out + n; }
+	};
+
+	// awaitable for parallel_reduce()
+	template<typename It, typename T, typename Op>
+	class parallel_reduce_awaitable : public detail::_parallel_awaitable<parallel_reduce_awaitable<It, T, Op>>
+	{
+	private: // -- private utility info -- //
+
+		typedef detail::_parallel_awaitable<parallel_reduce_awaitable> base;
+		friend base;
+
+	private: // -- data -- //
+
+		It                            first;
+		T                             init;
+		Op                            op;
+		std::size_t                   n, chunks = 0;
+		std::vector<std::optional<T>> partials;
+
+	private: // -- phases -- //
+
+		std::size_t _start()
+		{
+			if (!n) return 0;
+			partials.resize(chunks = this->_chunks_for(n));
+			return chunks;
+		}
+		void _chunk(std::size_t i)
+		{
+			It b = first + detail::_chunk_bound(n, chunks, i), e = first + detail::_chunk_bound(n, chunks, i + 1);
+			T acc = *b;
+			while (++b != e) acc = op(std::move(acc), *b);
+			partials[i].emplace(std::move(acc));
+		}
+		std::size_t _next_phase() { return 0; }
+
+	public: // -- ctor / dtor / asgn -- //
+
+		template<typename U, typename V>
+		parallel_reduce_awaitable(thread_pool &p, It _first, It last, U &&_init, V &&_op) : base(p), first(_first), init(std::forward<U>(_init)), op(std::forward<V>(_op)), n((std::size_t)(last - _first)) {}
+
+	public: // -- await interface -- //
+
+		T await_resume()
+		{
+			this->_rethrow();
+			for (std::optional<T> &p : partials) init = op(std::move(init), std::move(*p));
+			return std::move(init);
+		}
+	};
+
+	// awaitable for parallel_sort()
+	template<typename It, typename Comp>
+	class parallel_sort_awaitable : public detail::_parallel_awaitable<parallel_sort_awaitable<It, Comp>>
+	{
+	private: // -- private utility info -- //
+
+		typedef detail::_parallel_awaitable<parallel_sort_awaitable> base;
+		friend base;
+
+		static inline constexpr std::size_t min_grain = 2048; // sorting smaller runs in parallel is not worth the merges
+
+	private: // -- data -- //
+
+		It          first;
+		Comp        comp;
+		std::size_t n, runs = 0;
+		std::size_t width = 0; // runs per sorted block - 0 during the initial sort phase
+
+	private: // -- phases -- //
+
+		std::size_t _start() { return n > 1 ? runs = this->_chunks_for(n, min_grain) : 0; }
+		void _chunk(std::size_t i)
+		{
+			auto at = [&](std::size_t run) { return first + detail::_chunk_bound(n, runs, std::min(run, runs)); };
+			if (!width) std::sort(at(i), at(i + 1), comp);
+			else std::inplace_merge(at(2 * width * i), at(2 * width * i + width), at(2 * width * i + 2 * width), comp);
+		}
+		// each merge phase merges adjacent pairs of sorted blocks, doubling their width
+		std::size_t _next_phase()
+		{
+			width = width ? 2 * width : 1;
+			return width < runs ? (runs - width + 2 * width - 1) / (2 * width) : 0;
+		}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		template<typename U>
+		parallel_sort_awaitable(thread_pool &p, It _first, It last, U &&_comp) : base(p), first(_first), comp(std::forward<U>(_comp)), n((std::size_t)(last - _first)) {}
+
+	public: // -- await interface -- //
+
+		void await_resume() { this->_rethrow(); }
+	};
+
+	// returns an awaitable which computes *(out + i) = f(*(first + i)) for each element of [first, last) in parallel on pool, and yields the end of the output range.
+	// the range is split into chunks automatically (a few per worker) - the awaiting coroutine is parked (not blocking a thread) until all of them are done.
+	// if f throws, the remaining chunks still run and the first exception is rethrown by co_await.
+	// the iterators must be random access, and the ranges and f must remain valid until the awaitable completes.
+	template<typename InIt, typename OutIt, typename F>
+	parallel_transform_awaitable<InIt, OutIt, std::decay_t<F>> parallel_transform(thread_pool &pool, InIt first, InIt last, OutIt out, F &&f)
+	{
+		return { pool, first, last, out, std::forward<F>(f) };
+	}
+	// equivalent to parallel_transform(pool, std::begin(range), std::end(range), out, f)
+	template<typename Range, typename OutIt, typename F>
+	auto parallel_transform(thread_pool &pool, Range &range, OutIt out, F &&f) { return parallel_transform(pool, std::begin(range), std::end(range), out, std::forward<F>(f)); }
+
+	// returns an awaitable which reduces [first, last) with op in parallel on pool, and yields op(...op(op(init, a), b)..., z) - op must be associative (it need not be commutative).
+	// each chunk is reduced from its first element, and the partial results are then folded into init in order (see parallel_transform() for chunking and exceptions).
+	template<typename It, typename T, typename Op>
+	parallel_reduce_awaitable<It, std::decay_t<T>, std::decay_t<Op>> parallel_reduce(thread_pool &pool, It first, It last, T &&init, Op &&op)
+	{
+		return { pool, first, last, std::forward<T>(init), std::forward<Op>(op) };
+	}
+	// equivalent to parallel_reduce(pool, std::begin(range), std::end(range), init, op)
+	template<typename Range, typename T, typename Op>
+	auto parallel_reduce(thread_pool &pool, Range &range, T &&init, Op &&op) { return parallel_reduce(pool, std::begin(range), std::end(range), std::forward<T>(init), std::forward<Op>(op)); }
+
+	// returns an awaitable which sorts [first, last) by comp in parallel on pool (parallel merge sort) - the runs are sorted concurrently, then merged pairwise in concurrent rounds.
+	// the sort is not stable (see parallel_transform() for chunking and exceptions).
+	template<typename It, typename Comp = std::less<>>
+	parallel_sort_awaitable<It, std::decay_t<Comp>> parallel_sort(thread_pool &pool, It first, It last, Comp &&comp = {})
+	{
+		return { pool, first, last, std::forward<Comp>(comp) };
+	}
+	// equivalent to parallel_sort(pool, std::begin(range), std::end(range), comp)
+	template<typename Range, typename Comp = std::less<>>
+	auto parallel_sort(thread_pool &pool, Range &range, Comp &&comp = {}) { return parallel_sort(pool, std::begin(range), std::end(range), std::forward<Comp>(comp)); }
+
+	// --------------------- //
+
+	// -- synchronization -- //
+
+	// --------------------- //
+
+	class async_mutex;
+	class async_condition_variable;
+
+	namespace detail
+	{
+		// an (intrusive) coroutine waiting to acquire an async_mutex - stored in the awaitable, so waiting never allocates.
+		// condition variable waiters use the same node, so a notification can move them straight into the mutex's queue.
+		struct _mutex_waiter
+		{
+			_mutex_waiter            *next = nullptr;
+			_parker                   parker;
+			async_mutex              *mutex = nullptr;
+			async_condition_variable *cv = nullptr;    // for condition waits, the condition variable being waited on
+			bool                    (*ready)(_mutex_waiter&) = nullptr; // for condition waits with a predicate, re-checks it once the mutex is held on the waiter's behalf
+		};
+	}
+
+	// async_mutex is a mutual exclusion lock for coroutines - waiting to acquire it parks the awaiting coroutine instead of blocking a thread.
+	// ownership is handed directly to the next waiter in FIFO order on unlock() (the lock is never up for grabs while coroutines are queued).
+	class async_mutex
+	{
+	private: // -- private utility info -- //
+
+		typedef detail::_mutex_waiter waiter;
+
+		friend class async_condition_variable;
+
+	private: // -- data -- //
+
+		std::mutex mutex;          // guards the fields below
+		bool       locked = false;
+		waiter    *head = nullptr; // FIFO queue of waiters
+		waiter   **tail = &head;
+#ifdef COUTIL_DEADLOCK
+		detail::_wait_resource resource{ this, "async_mutex", mutex };
+#endif
+
+	private: // -- private util -- //
+
+		// records s (null if none) as the owner of the mutex - mutex must be held (does nothing unless COUTIL_DEADLOCK is defined)
+		void _note_owner([[maybe_unused]] const detail::_park_state *s)
+		{
+#ifdef COUTIL_DEADLOCK
+			if (s) s->blocked_on.store(nullptr, std::memory_order_relaxed);
+			resource.owner.store(s, std::memory_order_relaxed);
+#endif
+		}
+		// records the chain of waiters from first to last as queued on the mutex - mutex must be held (does nothing unless COUTIL_DEADLOCK is defined)
+		void _note_queued([[maybe_unused]] waiter *first, [[maybe_unused]] waiter *last)
+		{
+#ifdef COUTIL_DEADLOCK
+			for (;; first = first->next)
+			{
+				first->parker.parked_state()->blocked_on.store(&resource, std::memory_order_relaxed);
+				if (first == last) break;
+			}
+#endif
+		}
+
+		// gives ownership of the (locked) mutex to w - if w is a condition waiter whose predicate does not hold, it goes back to waiting on its condition variable instead
+		void _grant(waiter &w);
+
+		// appends a chain of waiters to the queue - if the mutex is free, the first one acquires it
+		void _append(waiter *first, waiter *last)
+		{
+			waiter *granted = nullptr;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!locked)
+				{
+					locked = true;
+					granted = first;
+					_note_owner(granted->parker.parked_state());
+					first = first == last ? nullptr : first->next;
+				}
+				if (first)
+				{
+					_note_queued(first, last);
+					last->next = nullptr;
+					*tail = first;
+					tail = &last->next;
+				}
+			}
+			if (granted) _grant(*granted);
+		}
+
+		// acquires the mutex if it is free (returns true), otherwise parks h and enqueues w (returns false)
+		template<typename P>
+		bool _lock_or_enqueue(waiter &w, std::experimental::coroutine_handle<P> h, const void *site)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!locked)
+			{
+				_note_owner(&h.promise());
+				return locked = true;
+			}
+
+			w.parker.park(h, site, metrics::primitive::async_mutex);
+			_note_queued(&w, &w);
+			w.next = nullptr;
+			*tail = &w;
+			tail = &w.next;
+			return false;
+		}
+
+	public: // -- awaitables -- //
+
+		// awaitable which acquires the mutex (see lock())
+		class lock_awaitable
+		{
+		protected: // -- data -- //
+
+			async_mutex &m;
+			waiter       w;
+
+		public: // -- ctor / dtor / asgn -- //
+
+			explicit lock_awaitable(async_mutex &_m) : m(_m) { w.mutex = &m; }
+
+			lock_awaitable(const lock_awaitable&) = delete;
+			lock_awaitable &operator=(const lock_awaitable&) = delete;
+
+		public: // -- await interface -- //
+
+			bool await_ready() { return m.try_lock(); }
+			template<typename P>
+			COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h) { return !m._lock_or_enqueue(w, h, COUTIL_SITE()); }
+			void await_resume() {}
+		};
+		// awaitable which acquires the mutex and yields an async_lock owning it (see scoped_lock())
+		class scoped_lock_awaitable : public lock_awaitable
+		{
+		public: // -- ctor / dtor / asgn -- //
+
+			using lock_awaitable::lock_awaitable;
+
+		public: // -- await interface -- //
+
+			class async_lock await_resume();
+		};
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// constructs an (unlocked) mutex
+		async_mutex() = default;
+
+		async_mutex(const async_mutex&) = delete;
+		async_mutex &operator=(const async_mutex&) = delete;
+
+	public: // -- interface -- //
+
+		// attempts to acquire the mutex without waiting - returns true on success
+		bool try_lock()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (locked) return false;
+#ifdef COUTIL_DEADLOCK
+			_note_owner(detail::_current_state());
+#endif
+			return locked = true;
+		}
+
+		// returns an awaitable which acquires the mutex - e.g. co_await m.lock().
+		// the mutex must later be released with unlock().
+		lock_awaitable lock() { return lock_awaitable{ *this }; }
+		// returns an awaitable which acquires the mutex and yields an async_lock that releases it - e.g. async_lock lock = co_await m.scoped_lock().
+		scoped_lock_awaitable scoped_lock() { return scoped_lock_awaitable{ *this }; }
+
+		// releases the mutex - ownership is handed directly to the next waiter (if any).
+		// the mutex must currently be locked.
+		void unlock();
+	};
+
+	// async_lock is a movable owner of a locked async_mutex (analogous to std::unique_lock) - it is required for waiting on an async_condition_variable.
+	class async_lock
+	{
+	private: // -- data -- //
+
+		async_mutex *m = nullptr;
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// constructs an async_lock which does not own a mutex
+		async_lock() = default;
+		// constructs an async_lock which takes ownership of an already-locked mutex
+		async_lock(async_mutex &_m, std::adopt_lock_t) : m(&_m) {}
+
+		// unlocks the owned mutex (if any)
+		~async_lock() { if (m) m->unlock(); }
+
+		async_lock(const async_lock&) = delete;
+		async_lock &operator=(const async_lock&) = delete;
+
+		// steals ownership from other - other no longer owns a mutex
+		async_lock(async_lock &&other) : m(std::exchange(other.m, nullptr)) {}
+		// unlocks the owned mutex (if any) and steals ownership from other - other no longer owns a mutex.
+		// on self assignment, does nothing.
+		async_lock &operator=(async_lock &&other)
+		{
+			if (this != &other)
+			{
+				if (m) m->unlock();
+				m = std::exchange(other.m, nullptr);
+			}
+			return *this;
+		}
+
+	public: // -- interface -- //
+
+		// returns true if this async_lock owns a mutex
+		bool owns_lock() const { return m; }
+		explicit operator bool() const { return owns_lock(); }
+
+		// gets the owned mutex (or null if none)
+		async_mutex *mutex() const { return m; }
+
+		// unlocks the owned mutex - afterwards this async_lock no longer owns it.
+		// if no mutex is owned, throws std::invalid_argument.
+		void unlock()
+		{
+			if (!m) throw std::invalid_argument("Attempt to unlock an async_lock which does not own a mutex");
+			std::exchange(m, nullptr)->unlock();
+		}
+	};
+
+	inline async_lock async_mutex::scoped_lock_awaitable::await_resume() { return async_lock{ m, std::adopt_lock }; }
+
+	// async_condition_variable lets coroutines wait (parked) for a condition protected by an async_mutex.
+	// notifying moves waiters straight into the mutex's queue (wait morphing) instead of waking them to contend for it, so each is resumed only once it owns the mutex.
+	class async_condition_variable
+	{
+	private: // -- private utility info -- //
+
+		typedef detail::_mutex_waiter waiter;
+
+		friend class async_mutex;
+
+	private: // -- data -- //
+
+		std::mutex mutex;          // guards the fields below
+		waiter    *head = nullptr; // FIFO queue of waiters
+		waiter   **tail = &head;
+
+	private: // -- private util -- //
+
+		void _enqueue(waiter &w)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			w.next = nullptr;
+			*tail = &w;
+			tail = &w.next;
+		}
+
+	public: // -- awaitables -- //
+
+		// awaitable which releases the mutex, waits for a notification (and for pred to hold, if given) and then reacquires the mutex (see wait()).
+		// Pred is std::nullptr_t if there is no predicate.
+		template<typename Pred>
+		class wait_awaitable : private waiter
+		{
+		private: // -- private utility info -- //
+
+			static inline constexpr bool has_pred = !std::is_same_v<Pred, std::nullptr_t>;
+
+			static bool _ready(waiter &w) { return static_cast<wait_awaitable&>(w).pred(); }
+
+		private: // -- data -- //
+
+			async_condition_variable &c;
+			Pred                      pred;
+
+		public: // -- ctor / dtor / asgn -- //
+
+			template<typename P>
+			wait_awaitable(async_condition_variable &_c, async_lock &lock, P &&p) : c(_c), pred(std::forward<P>(p))
+			{
+				if (!lock.owns_lock()) throw std::invalid_argument("Attempt to wait on a condition variable without owning a mutex");
+				mutex = lock.mutex();
+				cv = &c;
+				if constexpr (has_pred) ready = &_ready;
+			}
+
+			wait_awaitable(const wait_awaitable&) = delete;
+			wait_awaitable &operator=(const wait_awaitable&) = delete;
+
+		public: // -- await interface -- //
+
+			bool await_ready()
+			{
+				if constexpr (has_pred) return pred();
+				else return false;
+			}
+			template<typename P>
+			COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+			{
+				parker.park(h, COUTIL_SITE(), metrics::primitive::condition_variable);
+				c._enqueue(*this);
+				mutex->unlock();
+				return parker.parked(); // may have already been notified and granted the mutex
+			}
+			void await_resume() {}
+		};
+
+	public: // -- ctor / dtor / asgn -- //
+
+		async_condition_variable() = default;
+
+		async_condition_variable(const async_condition_variable&) = delete;
+		async_condition_variable &operator=(const async_condition_variable&) = delete;
+
+	public: // -- interface -- //
+
+		// returns an awaitable which atomically releases the lock's mutex and waits for a notification, then reacquires the mutex - e.g. co_await cv.wait(lock).
+		// if lock does not own a mutex, throws std::invalid_argument.
+		wait_awaitable<std::nullptr_t> wait(async_lock &lock) { return { *this, lock, nullptr }; }
+		// as wait(lock), but only completes once pred() (evaluated while holding the mutex) returns true - e.g. co_await cv.wait(lock, pred).
+		// pred is checked without suspending first, and afterwards whenever the mutex is acquired on the waiter's behalf (potentially by the thread which released it).
+		template<typename Pred>
+		wait_awaitable<std::decay_t<Pred>> wait(async_lock &lock, Pred &&pred) { return { *this, lock, std::forward<Pred>(pred) }; }
+
+		// moves the first waiter (if any) into its mutex's queue
+		void notify_one()
+		{
+			waiter *w;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!(w = head)) return;
+				if (!(head = w->next)) tail = &head;
+			}
+			w->mutex->_append(w, w);
+		}
+		// moves all waiters into their mutexes' queues (each mutex is only locked once per run of waiters using it)
+		void notify_all()
+		{
+			waiter *w;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				w = std::exchange(head, nullptr);
+				tail = &head;
+			}
+			while (w)
+			{
+				waiter *first = w, *last = w;
+				while (last->next && last->next->mutex == first->mutex) last = last->next;
+				w = last->next;
+				first->mutex->_append(first, last);
+			}
+		}
+	};
+
+	inline void async_mutex::_grant(waiter &w)
+	{
+		if (!w.ready || w.ready(w)) return w.parker.unpark();
+
+		w.cv->_enqueue(w);
+		unlock();
+	}
+	inline void async_mutex::unlock()
+	{
+		for (;;)
+		{
+			waiter *w;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!(w = head)) { locked = false; _note_owner(nullptr); return; }
+				if (!(head = w->next)) tail = &head;
+				_note_owner(w->parker.parked_state());
+			}
+
+			// the mutex now belongs to w - unless it is a condition waiter whose predicate does not hold yet, in which case it goes back to its condition variable
+			if (!w->ready || w->ready(*w)) return w->parker.unpark();
+			w->cv->_enqueue(*w);
+		}
+	}
+
+#ifdef COUTIL_RCU
+	namespace detail
+	{
+		// the global rcu state - the epoch, the markers of all threads which have read a snapshot, and the replaced versions waiting for their grace period
+		class _rcu_domain
+		{
+		private: // -- private utility info -- //
+
+			struct retired
+			{
+				std::uint64_t epoch;             // the epoch at which the version was replaced - readers which started reading before it may still hold it
+				void         *ptr;
+				void        (*destroy)(void*);
+			};
+
+			static inline constexpr timer_service::clock::duration min_delay = std::chrono::milliseconds(1);
+			static inline constexpr timer_service::clock::duration max_delay = std::chrono::milliseconds(256);
+
+		private: // -- data -- //
+
+			std::atomic<std::uint64_t> epoch{ 1 }; // 0 is reserved for quiescent threads
+
+			std::mutex                      mutex;  // guards the fields below
+			_rcu_thread                    *threads = nullptr;
+			std::vector<retired>            pending;
+			timer_service::entry            timer;  // background reclamation - queued while there are pending versions
+			bool                            timer_queued = false;
+			timer_service::clock::duration  delay = min_delay; // backs off while a reader holds up reclamation
+
+		private: // -- private util -- //
+
+			// the timer callback - reclaims what it can and polls again (less often) until nothing is pending
+			static void _fire(timer_service::entry&)
+			{
+				_rcu_domain &d = get();
+				d.reclaim();
+
+				std::lock_guard<std::mutex> lock(d.mutex);
+				if (d.pending.empty()) { d.timer_queued = false; return; }
+				d.delay = std::min(d.delay * 2, max_delay);
+				d.timer.deadline = timer_service::clock::now() + d.delay;
+				timer_service::global().schedule(d.timer);
+			}
+
+			// the calling thread's registered marker (registering it on first use)
+			_rcu_thread &_this_thread()
+			{
+				thread_local struct _registration
+				{
+					_rcu_thread record;
+
+					_registration()
+					{
+						_rcu_domain &d = get();
+						std::lock_guard<std::mutex> lock(d.mutex);
+						record.next = d.threads;
+						d.threads = &record;
+					}
+					// the thread is exiting - unlink the marker under the domain mutex (so a running scan is done with it) and forget it before its storage goes away
+					~_registration()
+					{
+						_rcu_local &local = _this_rcu_local();
+						if (local.record == &record) { local.record = nullptr; local.online = false; }
+
+						_rcu_domain &d = get();
+						std::lock_guard<std::mutex> lock(d.mutex);
+						for (_rcu_thread **p = &d.threads; *p; p = &(*p)->next) if (*p == &record) { *p = record.next; break; }
+					}
+				} registration;
+				return registration.record;
+			}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			// the timer service is constructed first so that it outlives the domain
+			_rcu_domain() { timer_service::global(); timer.fire = &_fire; }
+			// reclaims all pending versions - no thread may still be reading at this point
+			~_rcu_domain()
+			{
+				timer_service::global().cancel(timer);
+				for (retired &r : pending) r.destroy(r.ptr);
+			}
+
+			_rcu_domain(const _rcu_domain&) = delete;
+			_rcu_domain &operator=(const _rcu_domain&) = delete;
+
+			static _rcu_domain &get() { static _rcu_domain domain; return domain; }
+
+		public: // -- interface -- //
+
+			// marks the calling thread as reading - until its next quiescent point, no version it could see is reclaimed
+			void online(_rcu_local &local)
+			{
+				if (!local.record) local.record = &_this_thread();
+				local.record->epoch.store(epoch.load(std::memory_order_acquire), std::memory_order_release);
+				std::atomic_thread_fence(std::memory_order_seq_cst); // the marker must be visible before the snapshot is loaded
+				local.online = true;
+				local.online_depth = local.depth;
+			}
+
+			// hands over a replaced version - it is destroyed once every thread which could still hold it has passed a quiescent point
+			void retire(void *ptr, void (*destroy)(void*))
+			{
+				std::uint64_t e = epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+				std::lock_guard<std::mutex> lock(mutex);
+				pending.push_back({ e, ptr, destroy });
+				if (timer_queued) return;
+
+				timer_queued = true;
+				delay = min_delay;
+				timer.deadline = timer_service::clock::now() + delay;
+				timer_service::global().schedule(timer);
+			}
+
+			// destroys the pending versions whose grace period has passed - returns the number still pending
+			std::size_t reclaim()
+			{
+				std::vector<retired> expired;
+				std::size_t left;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in online()
+
+					std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+					for (_rcu_thread *t = threads; t; t = t->next)
+					{
+						std::uint64_t e = t->epoch.load(std::memory_order_acquire);
+						if (e != 0 && e < oldest) oldest = e;
+					}
+
+					auto keep = std::stable_partition(pending.begin(), pending.end(), [&](const retired &r) { return r.epoch > oldest; });
+					expired.assign(keep, pending.end());
+					pending.erase(keep, pending.end());
+					left = pending.size();
+				}
+				for (retired &r : expired) r.destroy(r.ptr); // destructors run outside the lock
+				return left;
+			}
+		};
+	}
+
+	// rcu_cell<T> holds a read-mostly value (e.g. a routing table) which readers access with no synchronization against writers - no locks and no shared reference counts.
+	// each write installs a new version, and a reader keeps seeing the version it read until its thread passes a quiescent point, after which the old version may be reclaimed.
+	// a thread passes a quiescent point when it leaves the outermost coroutine resume in which it read (i.e. between coroutine resumes), or when it calls rcu_quiescent().
+	// replaced versions are reclaimed in the background (on the timer_service thread) once every thread which read before the replacement has passed a quiescent point.
+	// only available if COUTIL_RCU is defined - tracking quiescent points adds a thread_local resume depth update to every coroutine resume.
+	template<typename T>
+	class rcu_cell
+	{
+	private: // -- data -- //
+
+		std::atomic<T*> current;
+		std::mutex      writer; // serializes writers (readers never take it)
+
+	private: // -- private util -- //
+
+		static void _destroy(void *p) { delete static_cast<T*>(p); }
+
+		// installs next and retires the previous version - the writer lock must be held
+		void _replace(T *next) { detail::_rcu_domain::get().retire(current.exchange(next, std::memory_order_acq_rel), &_destroy); }
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// constructs a cell holding the given initial value
+		explicit rcu_cell(T value = T{}) : current(new T(std::move(value))) {}
+		// constructs a cell holding an initial value constructed in place from args
+		template<typename ...Args>
+		explicit rcu_cell(std::in_place_t, Args &&...args) : current(new T(std::forward<Args>(args)...)) {}
+
+		// destroys the current version - no thread may still be reading it (replaced versions are reclaimed as usual)
+		~rcu_cell() { delete current.load(std::memory_order_relaxed); }
+
+		rcu_cell(const rcu_cell&) = delete;
+		rcu_cell &operator=(const rcu_cell&) = delete;
+
+	public: // -- interface -- //
+
+		// gets the current version. the pointer stays valid until the calling thread's next quiescent point, so it must not be held across a suspension point.
+		// only the first read after a quiescent point does any work (it publishes the thread's epoch marker) - later reads are a single atomic load.
+		// a thread reading outside of any coroutine stays online until it calls rcu_quiescent() - until then it holds back reclamation, so it should call it periodically.
+		// a thread which exits while online releases its hold as it exits (it must not read from thread_local destructors which run after its rcu registration is gone).
+		const T *read() const
+		{
+			detail::_rcu_local &local = detail::_this_rcu_local();
+			if (!local.online) detail::_rcu_domain::get().online(local);
+			return current.load(std::memory_order_acquire);
+		}
+
+		// publishes a new version - readers see it from their next read on
+		void publish(T value) { emplace(std::move(value)); }
+		// publishes a new version constructed in place from args
+		template<typename ...Args>
+		void emplace(Args &&...args)
+		{
+			T *next = new T(std::forward<Args>(args)...);
+			std::lock_guard<std::mutex> lock(writer);
+			_replace(next);
+		}
+		// publishes a modified copy of the current version - f is invoked with the copy (concurrent updates are serialized, so none are lost).
+		// if f throws, nothing is published.
+		template<typename F>
+		void update(F &&f)
+		{
+			std::lock_guard<std::mutex> lock(writer);
+			std::unique_ptr<T> next(new T(*current.load(std::memory_order_relaxed))); // writers are serialized, so the current version cannot be retired under us
+			std::forward<F>(f)(*next);
+			_replace(next.release());
+		}
+	};
+
+	// marks a quiescent point for the calling thread - it must not hold any rcu_cell snapshots (see rcu_cell::read()).
+	// this is only needed by threads which read outside of coroutines - coutil drivers pass quiescent points between resumes.
+	inline void rcu_quiescent()
+	{
+		detail::_rcu_local &local = detail::_this_rcu_local();
+		if (local.online) detail::_rcu_quiescent(local);
+	}
+
+	// immediately reclaims the replaced rcu_cell versions whose grace period has passed (this otherwise happens in the background) - returns the number still pending
+	inline std::size_t rcu_reclaim() { return detail::_rcu_domain::get().reclaim(); }
+#endif
+
+	// -------------- //
+
+	// -- channels -- //
+
+	// -------------- //
+
+	// oneshot<T> is the shared block of a single-value channel - a sender completes it once (from a callback, another thread, etc.) and a receiver co_awaits the result.
+	// no coroutine frame is involved: the result and the (single) waiter live in the block, and each side performs a single atomic operation on it.
+	// the block is either caller-provided storage (a oneshot object, which must outlive its endpoints) or allocated by oneshot<T>::make() and freed with its last endpoint.
+	template<typename T>
+	class oneshot
+	{
+	private: // -- data -- //
+
+		std::atomic<void*>      waiter{ nullptr }; // null while pending, the block's own address once completed, or the parker of the suspended receiver
+		detail::_async_result<T> result;
+		std::atomic<int>        refs{ 0 };          // endpoint references (only if heap)
+		bool                    heap = false;
+
+	private: // -- private util -- //
+
+		void _release() { if (heap && refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this; }
+
+	public: // -- endpoints -- //
+
+		// the completing end of a oneshot - completing (or destroying) it releases it
+		class sender
+		{
+		private: // -- data -- //
+
+			oneshot *block = nullptr;
+
+			friend class oneshot;
+
+			explicit sender(oneshot *b) : block(b) {}
+
+		private: // -- private util -- //
+
+			// publishes the (already stored) result and wakes the receiver if it is waiting
+			void _complete()
+			{
+				oneshot *b = std::exchange(block, nullptr);
+				void *prev = b->waiter.exchange(b, std::memory_order_acq_rel);
+				b->_release(); // the receiver still holds a reference
+				if (prev) static_cast<detail::_parker*>(prev)->unpark();
+			}
+			oneshot &_get()
+			{
+				if (!block) throw bad_coroutine_access("Accessing empty oneshot sender");
+				return *block;
+			}
+			void _break()
+			{
+				if (!block) return;
+				block->result.set_exception(std::make_exception_ptr(broken_promise("oneshot sender was destroyed without completing")));
+				_complete();
+			}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			// constructs an empty sender
+			sender() = default;
+
+			// if not yet completed, completes the oneshot with broken_promise
+			~sender() { _break(); }
+
+			sender(const sender&) = delete;
+			sender &operator=(const sender&) = delete;
+
+			sender(sender &&other) : block(std::exchange(other.block, nullptr)) {}
+			// breaks the currently-held oneshot (if any) and steals other's - on self assignment, does nothing
+			sender &operator=(sender &&other)
+			{
+				if (this != &other)
+				{
+					_break();
+					block = std::exchange(other.block, nullptr);
+				}
+				return *this;
+			}
+
+		public: // -- interface -- //
+
+			// returns true if this sender has not yet been completed (or moved from)
+			bool empty() const noexcept { return !block; }
+			explicit operator bool() const noexcept { return block; }
+
+			// completes the oneshot with a value constructed from args (if that throws, with the exception instead).
+			// if the sender is empty, throws bad_coroutine_access.
+			template<typename ...Args>
+			void set_value(Args &&...args) { _get().result.set_value(std::forward<Args>(args)...); _complete(); }
+			// completes the oneshot with an exception.
+			// if the sender is empty, throws bad_coroutine_access.
+			void set_exception(std::exception_ptr ex) { _get().result.set_exception(std::move(ex)); _complete(); }
+		};
+		// the awaiting end of a oneshot - co_await yields the value (moved out) or rethrows the exception it was completed with.
+		// it can be awaited only once, by one coroutine at a time.
+		class receiver
+		{
+		private: // -- data -- //
+
+			oneshot        *block = nullptr;
+			detail::_parker parker;
+
+			friend class oneshot;
+
+			explicit receiver(oneshot *b) : block(b) {}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			// constructs an empty receiver
+			receiver() = default;
+
+			~receiver() { if (block) block->_release(); }
+
+			receiver(const receiver&) = delete;
+			receiver &operator=(const receiver&) = delete;
+
+			// steals other's oneshot - other must not currently be awaited
+			receiver(receiver &&other) : block(std::exchange(other.block, nullptr)) {}
+			// releases the currently-held oneshot (if any) and steals other's - neither may currently be awaited. on self assignment, does nothing.
+			receiver &operator=(receiver &&other)
+			{
+				if (this != &other)
+				{
+					if (block) block->_release();
+					block = std::exchange(other.block, nullptr);
+				}
+				return *this;
+			}
+
+		public: // -- interface -- //
+
+			// returns true if this receiver does not refer to a oneshot
+			bool empty() const noexcept { return !block; }
+			explicit operator bool() const noexcept { return block; }
+
+			// returns true if the oneshot has been completed.
+			// if the receiver is empty, throws bad_coroutine_access.
+			bool ready() const
+			{
+				if (!block) throw bad_coroutine_access("Accessing empty oneshot receiver");
+				return block->waiter.load(std::memory_order_acquire) == block;
+			}
+
+		public: // -- await interface -- //
+
+			bool await_ready() { return ready(); }
+			template<typename P>
+			COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+			{
+				parker.park(h, COUTIL_SITE(), metrics::primitive::oneshot);
+				void *expected = nullptr;
+				if (!block->waiter.compare_exchange_strong(expected, &parker, std::memory_order_acq_rel, std::memory_order_acquire)) parker.unpark(); // completed in the meantime
+				return parker.parked();
+			}
+			T await_resume() { return block->result.get(); }
+		};
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// constructs a (pending) oneshot in caller-provided storage - it must outlive the endpoints obtained from it
+		oneshot() = default;
+
+		oneshot(const oneshot&) = delete;
+		oneshot &operator=(const oneshot&) = delete;
+
+		// allocates a shared oneshot block and returns its two endpoints - the block is freed once both have been destroyed
+		static std::pair<sender, receiver> make()
+		{
+			oneshot *b = new oneshot;
+			b->heap = true;
+			b->refs.store(2, std::memory_order_relaxed);
+			return { sender{ b }, receiver{ b } };
+		}
+
+	public: // -- interface -- //
+
+		// gets the sender / receiver of this (caller-provided) oneshot - each should be obtained once
+		sender get_sender() { return sender{ this }; }
+		receiver get_receiver() { return receiver{ this }; }
+	};
+
+	// watch<T> broadcasts the latest value of T to any number of readers - only the most recent publish() matters, intermediate values may be skipped.
+	// if T is trivially copyable, reads are lock-free and never block writers (a seqlock over T's bytes).
+	// otherwise (e.g. strings, containers) each value is an immutable shared snapshot, swapped under a mutex which readers only hold to copy the pointer.
+	// coroutines can co_await changed() to suspend until a newer version is published.
+	template<typename T>
+	class watch
+	{
+	private: // -- private utility info -- //
+
+		typedef std::uintptr_t word_t;
+
+		static inline constexpr bool        seqlocked = std::is_trivially_copyable_v<T>;
+		static inline constexpr std::size_t word_count = (sizeof(T) + sizeof(word_t) - 1) / sizeof(word_t);
+
+		// the current value of a trivially copyable T - its bytes, accessed with relaxed atomics so concurrent reads are race-free
+		struct bytes_t
+		{
+			std::atomic<word_t> data[word_count];
+		};
+		// the current value of any other T
+		struct shared_t
+		{
+			mutable std::mutex       mutex; // guards value (and orders it with the version)
+			std::shared_ptr<const T> value;
+		};
+
+		// a coroutine waiting in changed() - stored in the awaitable
+		struct waiter
+		{
+			waiter         *next = nullptr;
+			detail::_parker parker;
+		};
+
+	private: // -- data -- //
+
+		std::atomic<std::uint64_t>                         seq{ 0 }; // odd while a (seqlocked) publish is writing - the version is seq / 2
+		std::conditional_t<seqlocked, bytes_t, shared_t>   stat;
+
+		std::mutex mutex;          // serializes writers and guards the waiter list
+		waiter    *head = nullptr;
+
+	private: // -- private util -- //
+
+		// writes the bytes of a trivially copyable value (readers must be fenced off by an odd seq)
+		void _write(const T &value)
+		{
+			word_t words[word_count] = {};
+			std::memcpy(words, &value, sizeof(T));
+			for (std::size_t i = 0; i < word_count; ++i) stat.data[i].store(words[i], std::memory_order_relaxed);
+		}
+		// replaces the current value and increments the version - mutex must be held
+		void _store(T &&value)
+		{
+			std::uint64_t s = seq.load(std::memory_order_relaxed);
+			if constexpr (seqlocked)
+			{
+				seq.store(s + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				_write(value);
+				seq.store(s + 2, std::memory_order_release);
+			}
+			else
+			{
+				std::shared_ptr<const T> next = std::make_shared<const T>(std::move(value));
+				std::lock_guard<std::mutex> lock(stat.mutex);
+				next.swap(stat.value); // the previous value is released after the lock
+				seq.store(s + 2, std::memory_order_release);
+			}
+		}
+
+	public: // -- awaitables -- //
+
+		// awaitable which suspends until the version advances past a previously seen one, then yields the latest value (see changed())
+		class changed_awaitable : private waiter
+		{
+		private: // -- data -- //
+
+			watch         &w;
+			std::uint64_t  seen;
+			std::uint64_t *out;
+
+		public: // -- ctor / dtor / asgn -- //
+
+			changed_awaitable(watch &_w, std::uint64_t _seen, std::uint64_t *_out) : w(_w), seen(_seen), out(_out) {}
+
+			changed_awaitable(const changed_awaitable&) = delete;
+			changed_awaitable &operator=(const changed_awaitable&) = delete;
+
+		public: // -- await interface -- //
+
+			bool await_ready() const { return w.version() > seen; }
+			template<typename P>
+			COUTIL_SUSPEND_SITE bool await_suspend(std::experimental::coroutine_handle<P> h)
+			{
+				std::lock_guard<std::mutex> lock(w.mutex);
+				if (w.version() > seen) return false;
+
+				this->parker.park(h, COUTIL_SITE(), metrics::primitive::watch);
+				this->next = std::exchange(w.head, static_cast<waiter*>(this));
+				return true;
+			}
+			T await_resume() { return out ? w.get(*out) : w.get(); }
+		};
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// constructs a watch holding the given initial value (version 0)
+		explicit watch(T init = T{})
+		{
+			if constexpr (seqlocked) _write(init);
+			else stat.value = std::make_shared<const T>(std::move(init));
+		}
+
+		watch(const watch&) = delete;
+		watch &operator=(const watch&) = delete;
+
+	public: // -- interface -- //
+
+		// returns the version of the current value - each publish() increments it
+		std::uint64_t version() const { return seq.load(std::memory_order_acquire) / 2; }
+
+		// reads the current value and stores its version in version.
+		// for a trivially copyable T this never blocks - it only retries if a publish() overlaps the read.
+		T get(std::uint64_t &version) const
+		{
+			if constexpr (seqlocked)
+			{
+				word_t words[word_count];
+				for (;;)
+				{
+					std::uint64_t s0 = seq.load(std::memory_order_acquire);
+					if (s0 & 1) { std::this_thread::yield(); continue; }
+
+					for (std::size_t i = 0; i < word_count; ++i) words[i] = stat.data[i].load(std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_acquire);
+
+					if (seq.load(std::memory_order_relaxed) == s0) { version = s0 / 2; break; }
+				}
+
+				alignas(T) unsigned char raw[sizeof(T)];
+				std::memcpy(raw, words, sizeof(T));
+				return *std::launder(reinterpret_cast<T*>(raw));
+			}
+			else return *snapshot(version);
+		}
+		// reads the current value (see get(version))
+		T get() const { std::uint64_t v; return get(v); }
+
+		// gets a shared snapshot of the current value (without copying it unless T is trivially copyable) and stores its version in version
+		std::shared_ptr<const T> snapshot(std::uint64_t &version) const
+		{
+			if constexpr (seqlocked) return std::make_shared<const T>(get(version));
+			else
+			{
+				std::lock_guard<std::mutex> lock(stat.mutex);
+				version = seq.load(std::memory_order_relaxed) / 2;
+				return stat.value;
+			}
+		}
+		// gets a shared snapshot of the current value (see snapshot(version))
+		std::shared_ptr<const T> snapshot() const { std::uint64_t v; return snapshot(v); }
+
+		// publishes a new value (incrementing the version) and wakes all coroutines waiting in changed() in a single pass
+		void publish(T value)
+		{
+			waiter *w;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				_store(std::move(value));
+				w = std::exchange(head, nullptr);
+			}
+			while (w) std::exchange(w, w->next)->parker.unpark(); // next must be read before unparking
+		}
+
+		// returns an awaitable which suspends until a version newer than seen is published, then yields the latest value and stores its version in seen
+		changed_awaitable changed(std::uint64_t &seen) { return { *this, seen, &seen }; }
+		// returns an awaitable which suspends until a version newer than the current one is published, then yields the latest value
+		changed_awaitable changed() { return { *this, version(), nullptr }; }
+	};
+
+	// ------------------------ //
+
+	// -- deadlock detection -- //
+
+	// ------------------------ //
+
+	// if COUTIL_DEADLOCK is defined (which implies COUTIL_BACKTRACE), every async_mutex records the coroutine holding it and every coroutine queued on one records which.
+	// together with the awaiter links of the async backtraces this forms a wait-for graph - a coroutine waits for the owner of the primitive it is queued on and for the coroutines it co_awaits.
+	// a cycle in that graph is a deadlock: none of its coroutines can ever be resumed.
+
+#ifdef COUTIL_DEADLOCK
+	// one coroutine in a deadlock cycle
+	struct deadlock_link
+	{
+		std::vector<async_frame> backtrace;           // the async backtrace of the coroutine (innermost first)
+		const void              *resource = nullptr; // the primitive it is queued on, whose owner is the next coroutine in the cycle - null if it instead awaits the next coroutine
+		const char              *kind = nullptr;     // the type of the primitive (e.g. "async_mutex")
+	};
+
+	// a deadlock - each coroutine waits for the next one, and the last one waits for the first
+	typedef std::vector<deadlock_link> deadlock_cycle;
+
+	namespace detail
+	{
+		// gets the owner of the primitive s is queued on (if any) and stores the primitive in r - the registry mutex must be held
+		inline const _park_state *_blocker(const _park_state &s, const _wait_resource *&r)
+		{
+			if (!(r = s.blocked_on.load(std::memory_order_relaxed))) return nullptr;
+			std::lock_guard<std::mutex> lock(r->guard);
+			if (s.blocked_on.load(std::memory_order_relaxed) != r) return r = nullptr, nullptr; // granted in the meantime
+			return r->owner.load(std::memory_order_relaxed);
+		}
+		// returns true if s still waits for t through r (or, if r is null, still awaits t) - the registry mutex must be held
+		inline bool _still_waits(const _park_state &s, const _park_state *t, const _wait_resource *r)
+		{
+			if (!r) return t->awaiter.load(std::memory_order_relaxed) == &s;
+			const _wait_resource *now;
+			return _blocker(s, now) == t && now == r;
+		}
+	}
+
+	// builds the wait-for graph of all live coutil coroutines and returns its cycles (each one reported once).
+	// the graph is read while coroutines keep running, so every edge of a cycle is read twice before it is reported - a real deadlock is stable, so it is never missed.
+	// the registry mutex (which every frame construction and destruction takes) is only held to copy the graph and to confirm the cycles found - the search runs without it.
+	inline std::vector<deadlock_cycle> find_deadlocks()
+	{
+		typedef detail::_park_state state;
+		typedef std::pair<const state*, const detail::_wait_resource*> edge; // the coroutine waited for and the primitive (null for an await)
+
+		detail::_coroutine_registry &reg = detail::_coroutine_registry::get();
+		std::vector<const state*> nodes;
+		std::map<const state*, std::vector<edge>> edges;
+		{
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			std::set<const state*> live = detail::_live_coroutines();
+			nodes.assign(live.begin(), live.end());
+			for (const state *s : live)
+			{
+				if (const state *a = s->awaiter.load(std::memory_order_relaxed); a && live.count(a)) edges[a].push_back({ s, nullptr });
+
+				const detail::_wait_resource *r;
+				if (const state *owner = detail::_blocker(*s, r); owner && live.count(owner)) edges[s].push_back({ owner, r });
+			}
+		}
+
+		// depth first search over the copy (it only compares addresses) - an edge back to a coroutine on the current path closes a cycle
+		std::vector<std::vector<std::pair<const state*, edge>>> candidates; // each coroutine of a cycle with the edge to the next one
+		std::map<const state*, int> color; // 0 - unvisited, 1 - on the current path, 2 - done
+		for (const state *root : nodes)
+		{
+			if (color[root]) continue;
+			std::vector<std::pair<const state*, std::size_t>> path{ { root, 0 } }; // each coroutine with the index of its next edge
+			color[root] = 1;
+			while (!path.empty())
+			{
+				const state *s = path.back().first;
+				const std::vector<edge> &out = edges[s];
+				if (path.back().second == out.size()) { color[s] = 2; path.pop_back(); continue; }
+
+				const edge &e = out[path.back().second++];
+				if (color[e.first] == 0)
+				{
+					color[e.first] = 1;
+					path.push_back({ e.first, 0 });
+				}
+				else if (color[e.first] == 1)
+				{
+					std::size_t first = 0;
+					while (path[first].first != e.first) ++first;
+
+					std::vector<std::pair<const state*, edge>> candidate;
+					for (std::size_t i = first; i < path.size(); ++i)
+					{
+						const state *from = path[i].first;
+						candidate.push_back({ from, i + 1 < path.size() ? edges[from][path[i].second - 1] : e }); // the edge which led to the next coroutine on the path
+					}
+					candidates.push_back(std::move(candidate));
+				}
+			}
+		}
+
+		// read every edge of a candidate again and take the backtraces - the registry mutex keeps the coroutines (and the primitives they wait on) alive meanwhile
+		std::vector<deadlock_cycle> cycles;
+		if (candidates.empty()) return cycles;
+
+		std::lock_guard<std::mutex> lock(reg.mutex);
+		std::set<const state*> live = detail::_live_coroutines();
+		for (const auto &candidate : candidates)
+		{
+			bool stable = true;
+			for (const auto &[from, taken] : candidate)
+				stable = stable && live.count(from) && live.count(taken.first) && detail::_still_waits(*from, taken.first, taken.second);
+			if (!stable) continue;
+
+			deadlock_cycle cycle;
+			for (const auto &[from, taken] : candidate) cycle.push_back({ detail::_walk(from, live), taken.second ? taken.second->object : nullptr, taken.second ? taken.second->kind : nullptr });
+			cycles.push_back(std::move(cycle));
+		}
+		return cycles;
+	}
+
+	// writes deadlock cycles to os - each coroutine with what it waits on followed by its async backtrace, with cycles separated by blank lines
+	inline void write_deadlocks(std::ostream &os, const std::vector<deadlock_cycle> &cycles)
+	{
+		for (std::size_t i = 0; i < cycles.size(); ++i)
+		{
+			if (i) os << '\n';
+			os << "deadlock between " << cycles[i].size() << " coroutines:\n";
+			for (const deadlock_link &link : cycles[i])
+			{
+				if (link.resource) os << "waiting on " << link.kind << '@' << link.resource << " held by the next coroutine:\n";
+				else os << "awaiting the next coroutine:\n";
+				write_async_backtrace(os, link.backtrace);
+			}
+		}
+	}
+
+	// periodically searches for deadlocks on the timer thread (see find_deadlocks()) and passes newly found ones to a handler.
+	// a cycle is only reported once it has been found by two consecutive checks, and only once for as long as it persists.
+	// cost: each check copies the wait-for graph (linear in the number of live coroutines) under the registry mutex, delaying coroutine creation and destruction meanwhile,
+	// and the search occupies the shared timer thread, delaying other timers due meanwhile (e.g. sleep_for(), next_until() deadlines) - the handler should not block for the same reason.
+	class deadlock_detector : private timer_service::entry
+	{
+	public: // -- handler interface -- //
+
+		// receives the new deadlocks - it is invoked on the timer thread, so it should not block
+		typedef std::function<void(const std::vector<deadlock_cycle>&)> handler;
+
+	private: // -- private utility info -- //
+
+		typedef std::vector<const void*> cycle_key; // the sorted frame addresses of the coroutines in a cycle
+
+		static cycle_key _key(const deadlock_cycle &cycle)
+		{
+			cycle_key key;
+			for (const deadlock_link &link : cycle) key.push_back(link.backtrace.empty() ? nullptr : link.backtrace.front().frame);
+			std::sort(key.begin(), key.end());
+			return key;
+		}
+
+	private: // -- data -- //
+
+		handler                        on_deadlock;
+		timer_service::clock::duration interval;
+		std::set<cycle_key>            seen;     // the cycles found by the last check
+		std::set<cycle_key>            reported; // the (still present) cycles which have been reported
+
+		std::mutex                     mutex;    // guards stopping
+		bool                           stopping = false;
+
+	private: // -- private util -- //
+
+		static void _fire(timer_service::entry &e)
+		{
+			deadlock_detector &d = static_cast<deadlock_detector&>(e);
+
+			std::set<cycle_key> found, still_reported;
+			std::vector<deadlock_cycle> fresh;
+			for (deadlock_cycle &cycle : find_deadlocks())
+			{
+				cycle_key key = _key(cycle);
+				if (!found.insert(key).second) continue;
+				if (d.reported.count(key)) still_reported.insert(key);
+				else if (d.seen.count(key))
+				{
+					still_reported.insert(key);
+					fresh.push_back(std::move(cycle));
+				}
+			}
+			d.seen = std::move(found);
+			d.reported = std::move(still_reported);
+			if (!fresh.empty()) d.on_deadlock(fresh);
+
+			std::lock_guard<std::mutex> lock(d.mutex);
+			if (d.stopping) return;
+			d.deadline = timer_service::clock::now() + d.interval;
+			timer_service::global().schedule(d);
+		}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// starts checking every interval.
+		// if the handler is empty, throws std::invalid_argument.
+		explicit deadlock_detector(handler _on_deadlock, timer_service::clock::duration _interval = std::chrono::seconds(1)) : on_deadlock(std::move(_on_deadlock)), interval(_interval)
+		{
+			if (!on_deadlock) throw std::invalid_argument("Attempt to create a deadlock_detector without a handler");
+			fire = &_fire;
+			deadline = timer_service::clock::now() + interval;
+			timer_service::global().schedule(*this);
+		}
+		// stops checking - waits for a running check (and its handler) to finish
+		~deadlock_detector()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			timer_service::global().cancel(*this);
+		}
+
+		deadlock_detector(const deadlock_detector&) = delete;
+		deadlock_detector &operator=(const deadlock_detector&) = delete;
+	};
+#endif
+
+	// ------------------------------ //
+
+	// -- incremental computation -- //
+
+	// ------------------------------ //
+
+	namespace detail
+	{
+		template<typename T, typename = void>
+		struct _is_equality_comparable : std::false_type {};
+		template<typename T>
+		struct _is_equality_comparable<T, std::void_t<decltype(std::declval<const T&>() == std::declval<const T&>())>> : std::true_type {};
+	}
+
+	// incremental is a graph of memoized computations over versioned inputs.
+	// a derived node is a lazy_task computation which reads inputs and other derived nodes through its context - the nodes it reads are recorded as its dependencies (anew on each run).
+	// setting an input starts a new revision. a derived node evaluated afterwards is only re-run if one of its dependencies changed since it was last verified - otherwise its memoized value is reused.
+	// if a re-run produces a value equal to the previous one (for T with operator==), the node counts as unchanged, so the nodes depending on it are not re-run either (early cutoff).
+	// nodes are owned by the graph, which must be acyclic. inputs must not be set while an evaluation is running.
+	class incremental
+	{
+	public: // -- nodes -- //
+
+		class context;
+
+	private: // -- private utility info -- //
+
+		struct _run;
+		template<typename T> struct _run_of;
+
+	public: // -- nodes -- //
+
+		// the bookkeeping shared by input and derived nodes
+		class node
+		{
+		private: // -- data -- //
+
+			friend class incremental;
+
+			const bool                 is_input;
+			std::uint64_t              changed_at = 0;   // the revision in which the value last changed
+			std::atomic<std::uint64_t> verified_at{ 0 }; // the revision in which the value was last known to be up to date (derived nodes)
+			std::vector<node*>         deps;             // the nodes read by the last run, in the order they were read (derived nodes)
+			bool                       computed = false; // true once the node has a value (derived nodes)
+
+			// verification of a derived node is serialized by busy rather than by holding mutex - a run started by an evaluation releases it on whichever thread finishes the run
+			std::mutex                 mutex;            // guards busy
+			std::condition_variable    cv;               // signalled when busy is cleared
+			bool                       busy = false;
+
+			void _lock() { std::unique_lock<std::mutex> lock(mutex); cv.wait(lock, [this] { return !busy; }); busy = true; }
+			void _unlock() { { std::lock_guard<std::mutex> lock(mutex); busy = false; } cv.notify_all(); }
+
+			// re-runs the computation to completion on the calling thread, reading through ctx - returns true if the value changed
+			virtual bool _recompute(context&) { return false; }
+			// creates a run of the computation for an evaluation (see _run) - it is not started yet
+			virtual _run *_make_run(incremental&, void*, void (*)(void*, std::exception_ptr)) { return nullptr; }
+
+		protected: // -- ctor / dtor / asgn -- //
+
+			explicit node(bool input) : is_input(input) {}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			virtual ~node() = default;
+
+			node(const node&) = delete;
+			node &operator=(const node&) = delete;
+		};
+
+		// a node holding a value which is set from outside the graph (see make_input())
+		template<typename T>
+		class input : public node
+		{
+		private: // -- data -- //
+
+			friend class incremental;
+			friend class context;
+
+			incremental &graph;
+			T            value;
+
+			input(incremental &g, T init) : node(true), graph(g), value(std::move(init)) {}
+
+		public: // -- interface -- //
+
+			// gets the current value
+			const T &get() const noexcept { return value; }
+
+			// sets the value and starts a new revision - if T has operator== and the value is unchanged, does nothing.
+			// this must not be called while an evaluation of the graph is running.
+			void set(T v)
+			{
+				if constexpr (detail::_is_equality_comparable<T>::value) if (v == value) return;
+				value = std::move(v);
+				graph._changed(*this);
+			}
+		};
+
+		// a node holding the memoized result of a computation (see make_derived())
+		template<typename T>
+		class derived : public node
+		{
+		private: // -- data -- //
+
+			friend class incremental;
+			friend class context;
+
+			std::function<lazy_task<T>(context&)> fn;
+			std::optional<T>                      memo;
+
+			template<typename F>
+			explicit derived(F &&f) : node(false), fn(std::forward<F>(f)) {}
+
+			// stores a new value - returns true if it differs from the previous one
+			bool _store(T value)
+			{
+				if constexpr (detail::_is_equality_comparable<T>::value) if (memo && *memo == value) return false;
+				memo = std::move(value);
+				return true;
+			}
+
+			bool _recompute(context &ctx) override { return _store(fn(ctx).wait()); }
+			_run *_make_run(incremental &g, void *owner, void (*done)(void*, std::exception_ptr)) override { return new _run_of<T>(g, *this, owner, done); }
+		};
+
+		// the view of the graph given to a running computation - reading a node through it records the node as a dependency
+		class context
+		{
+		private: // -- data -- //
+
+			friend class incremental;
+
+			incremental       &graph;
+			std::vector<node*> deps;
+
+			explicit context(incremental &g) : graph(g) {}
+
+		public: // -- ctor / dtor / asgn -- //
+
+			context(const context&) = delete;
+			context &operator=(const context&) = delete;
+
+		public: // -- interface -- //
+
+			// gets the value of an input
+			template<typename T>
+			const T &get(input<T> &n) { deps.push_back(&n); return n.value; }
+			// gets the (up to date) value of a derived node - if it is out of date, it is brought up to date first on the calling thread
+			template<typename T>
+			const T &get(derived<T> &n) { graph._verify(n); deps.push_back(&n); return *n.memo; }
+		};
+
+	private: // -- private utility info -- //
+
+		template<typename> struct _lazy_result;
+		template<typename T> struct _lazy_result<basic_task<T, std::experimental::suspend_always>> { typedef T type; };
+
+		// a run of a derived node started by an evaluation (see _verify_async()) - it holds the node's lock from its creation until it finishes.
+		// once the computation finishes, the node is updated (unless it failed) and unlocked, and then done(owner, ex) is called (ex is null on success).
+		struct _run
+		{
+			incremental &graph;
+			node        &n;
+			context      ctx;
+			void        *owner;
+			void       (*done)(void *owner, std::exception_ptr ex);
+
+			_run(incremental &g, node &_n, void *o, void (*d)(void*, std::exception_ptr)) : graph(g), n(_n), ctx(g), owner(o), done(d) {}
+			virtual ~_run() = default;
+
+			// starts driving the computation on the calling thread - if it parks, this returns and whoever unparks it drives it on
+			virtual void _start() noexcept = 0;
+
+			void _finish(bool changed, std::exception_ptr ex) noexcept
+			{
+				if (!ex) graph._ran(n, ctx, changed);
+				n._unlock();
+				done(owner, std::move(ex));
+			}
+		};
+		// the run of a derived<T> - the task is driven as a task_sender, which completes the run on whichever thread finishes the computation
+		template<typename T>
+		struct _run_of : _run
+		{
+			struct receiver
+			{
+				_run_of *run;
 
-	// ---------------- //
+				void set_value(T value) noexcept
+				{
+					bool changed;
+					try { changed = static_cast<derived<T>&>(run->n)._store(std::move(value)); }
+					catch (...) { return run->_finish(false, std::current_exception()); }
+					run->_finish(changed, nullptr);
+				}
+				void set_error(std::exception_ptr e) noexcept { run->_finish(false, std::move(e)); }
+			};
 
-	// -- generators -- //
+			typename task_sender<T, std::experimental::suspend_always>::template operation<receiver> op;
 
-	// ---------------- //
+			_run_of(incremental &g, derived<T> &d, void *owner, void (*done)(void*, std::exception_ptr)) : _run(g, d, owner, done), op(d.fn(ctx), receiver{ this }) {}
 
-	// basic_generator represents a coroutine that co_yields zero or more values T and optionally co_returns (nothing) to end execution.
-	// has the ability to iterate over the generated sequence of values as a (single-pass) input iterator.
-	// execution of the coroutine body does not begin until a yield value is requested.
-	template<typename T>
-	class basic_generator
-	{
-	public: // -- promise -- //
+			void _start() noexcept override { op.start(); }
+		};
 
-		static_assert(!std::is_reference_v<T>, "T in basic_generator<T> cannot be of reference type");
+	private: // -- data -- //
 
-		struct promise_type;
-		typedef std::experimental::coroutine_handle<promise_type> handle;
+		std::uint64_t                      revision = 1;
+		std::vector<std::unique_ptr<node>> nodes;
+
+	private: // -- private util -- //
+
+		void _changed(node &n) { n.changed_at = ++revision; }
 
-		struct promise_type
+		// checks whether a derived node (whose lock is held) must be re-run - it must if it has no value yet or a dependency changed since it was last verified, otherwise it is marked as verified.
+		// the dependencies are verified in the order they were read, and checking stops at the first change (the new run may no longer read the rest).
+		bool _dirty(node &n)
 		{
-			std::variant<std::exception_ptr, T> stat; // holds the state information about this coroutine (ret or exception)
-			bool yield_flag = false;                  // flag used to mark when a yield value is obtained
+			std::uint64_t verified = n.verified_at.load(std::memory_order_relaxed);
+			if (verified == revision) return false;
 
-			auto get_return_object() { return basic_generator{ handle::from_promise(*this) }; }
+			bool dirty = !n.computed;
+			for (std::size_t i = 0; !dirty && i < n.deps.size(); ++i)
+			{
+				_verify(*n.deps[i]);
+				dirty = n.deps[i]->changed_at > verified;
+			}
+			if (!dirty) n.verified_at.store(revision, std::memory_order_release);
+			return dirty;
+		}
+		// records a finished run of a derived node (whose lock is held) and marks it as verified
+		void _ran(node &n, context &ctx, bool changed)
+		{
+			if (changed) n.changed_at = revision;
+			n.deps = std::move(ctx.deps);
+			n.computed = true;
+			n.verified_at.store(revision, std::memory_order_release);
+		}
 
-			auto initial_suspend() const noexcept { return std::experimental::suspend_always{}; }
-			auto final_suspend() const noexcept { return std::experimental::suspend_always{}; }
+		// brings a derived node up to date on the calling thread (see _dirty())
+		void _verify(node &n)
+		{
+			if (n.is_input || n.verified_at.load(std::memory_order_acquire) == revision) return;
 
-			template<typename U>
-			auto yield_value(U &&u)
+			struct _
 			{
-				// if we already have a T object, move assign it - otherwise move construct it
-				if (T *p = std::get_if<1>(&stat)) *p = std::forward<U>(u);
-				else stat.emplace<1>(std::forward<U>(u));
+				node &n;
+				_(node &_n) : n(_n) { n._lock(); }
+				~_() { n._unlock(); }
+			} sentry(n);
 
-				// mark that we now have a yield value
-				yield_flag = true;
+			if (!_dirty(n)) return;
+			context ctx{ *this };
+			bool changed = n._recompute(ctx);
+			_ran(n, ctx, changed);
+		}
+		// starts bringing a derived node up to date for an evaluation - returns true if it is up to date already.
+		// otherwise its computation is started as a run stored in slot, and false is returned - done(owner, ex) is called once the run finishes (see _run).
+		bool _verify_async(node &n, std::unique_ptr<_run> &slot, void *owner, void (*done)(void*, std::exception_ptr))
+		{
+			if (n.is_input || n.verified_at.load(std::memory_order_acquire) == revision) return true;
 
-				// suspend so that we can use it
-				return std::experimental::suspend_always{};
+			n._lock();
+			try
+			{
+				if (!_dirty(n)) { n._unlock(); return true; }
+				slot.reset(n._make_run(*this, owner, done));
 			}
+			catch (...) { n._unlock(); throw; }
 
-			void unhandled_exception()
+			slot->_start();
+			return false;
+		}
+
+		// groups the out of date derived nodes reachable from target (through the dependencies recorded by their last runs) by height - each level only depends on lower ones
+		std::vector<std::vector<node*>> _levels(node &target)
+		{
+			std::unordered_map<node*, std::size_t> heights;
+			std::vector<std::vector<node*>> levels;
+
+			// returns 1 + the height of n, or 0 if n needs no verification
+			auto visit = [&](auto &self, node &n) -> std::size_t
 			{
-				stat.emplace<0>(std::current_exception());
-			}
-		};
+				if (n.is_input || n.verified_at.load(std::memory_order_relaxed) == revision) return 0;
+				if (auto it = heights.find(&n); it != heights.end()) return it->second;
 
-	private: // -- data -- //
+				std::size_t h = 0;
+				for (node *d : n.deps) h = std::max(h, self(self, *d));
+				heights.emplace(&n, h + 1);
+				if (levels.size() <= h) levels.resize(h + 1);
+				levels[h].push_back(&n);
+				return h + 1;
+			};
+			visit(visit, target);
+			return levels;
+		}
 
-		handle co = nullptr; // the raw coroutine handle
+	public: // -- awaitables -- //
 
-	private: // -- private util -- //
+		// awaitable which brings a derived node up to date on a thread_pool and yields its value (see evaluate())
+		template<typename T>
+		class evaluate_awaitable : public detail::_parallel_awaitable<evaluate_awaitable<T>>
+		{
+		private: // -- private utility info -- //
 
-		basic_generator(handle h) : co(std::move(h)) {}
+			typedef detail::_parallel_awaitable<evaluate_awaitable> base;
+			friend base;
 
-	public: // -- ctor / dtor / asgn -- //
+		private: // -- data -- //
 
-		// constructs an empty basic_generator (does not refer to any existing coroutine)
-		basic_generator() = default;
+			incremental                                    &graph;
+			derived<T>                                     &target;
+			std::vector<std::vector<node*>>                 levels;
+			std::vector<std::vector<std::unique_ptr<_run>>> runs; // the runs started for each level (null for the nodes which were up to date) - freed with the awaitable
+			std::size_t                                     level = 0;
 
-		// destroys the currently-held coroutine handle (if any)
-		~basic_generator() { if (co) co.destroy(); }
+		private: // -- private util -- //
 
-		basic_generator(const basic_generator&) = delete;
-		basic_generator &operator=(const basic_generator&) = delete;
+			static void _run_done(void *self, std::exception_ptr ex)
+			{
+				evaluate_awaitable &a = *static_cast<evaluate_awaitable*>(self);
+				if (ex) a._chunk_failed(std::move(ex));
+				a._chunk_done();
+			}
 
-		// steals the handle of other - other is left in the empty state
-		basic_generator(basic_generator &&other) : co(std::exchange(other.co, nullptr)) {}
-		// discards the current coroutine handle and steals other's - other is left in the empty state.
-		// on self assignment, does nothing.
-		basic_generator &operator=(basic_generator &&other) { co = std::exchange(other.co, nullptr); return *this; }
+		private: // -- phases -- //
 
-	public: // -- state information -- //
+			std::size_t _start()
+			{
+				levels = graph._levels(target);
+				runs.resize(levels.size());
+				for (std::size_t i = 0; i < levels.size(); ++i) runs[i].resize(levels[i].size());
+				return levels.empty() ? 0 : levels[0].size();
+			}
+			bool _chunk(std::size_t i) { return graph._verify_async(*levels[level][i], runs[level][i], this, &_run_done); }
+			std::size_t _next_phase() { return ++level < levels.size() ? levels[level].size() : 0; }
 
-		// returns true if the basic_generator is currently in the empty state.
-		bool empty() const { return !co; }
+		public: // -- ctor / dtor / asgn -- //
 
-		// returns true if the basic_generator is non-empty
-		explicit operator bool() const { return !empty(); }
-		// returns true if the basic_generator is empty
-		bool operator!() const { return empty(); }
+			evaluate_awaitable(thread_pool &p, incremental &g, derived<T> &t) : base(p), graph(g), target(t) {}
 
-	public: // -- iterator -- //
+		public: // -- await interface -- //
 
-		class iterator
-		{
-		public: // -- pseudo-iterator -- //
+			const T &await_resume() { this->_rethrow(); graph._verify(target); return *target.memo; }
+		};
 
-			class pseudo_iterator
-			{
-			private: // -- data -- //
+	public: // -- ctor / dtor / asgn -- //
 
-				iterator *it;
+		// creates an empty graph
+		incremental() = default;
 
-			private: // -- private util -- //
+		incremental(const incremental&) = delete;
+		incremental &operator=(const incremental&) = delete;
 
-				friend class iterator;
+	public: // -- interface -- //
 
-				// constructs a pseudo_iterator to advance the given iterator.
-				// the provided iterator must have a valid (non-null) coroutine handle.
-				explicit pseudo_iterator(iterator &i) : it(&i)
-				{
-					// clear the yield flag and resume execution of the coroutine
-					it->co.promise().yield_flag = false;
-					it->co.resume();
-				}
+		// returns the current revision - each change of an input starts a new one
+		std::uint64_t current_revision() const noexcept { return revision; }
 
-				// returns true if the increment process has completed
-				bool done()
-				{
-					// if the coroutine has finished (no yield value) or we got a yield value, we're done with the increment process
-					return it->co.done() || it->co.promise().yield_flag;
-				}
-				// blocks until completion of the increment process and updates the iterator source.
-				// after everything is completed, sets this pseudo-iterator to the empty state.
-				void wait()
-				{
-					// wait for completion of the increment process
-					while (!done()) it->co.resume();
-					
-					// if the coroutine has finished execution (no yield value) destroy the coroutine and null it.
-					// this effectively sets the iterator it was sourced from to the end iterator state.
-					if (it->co.done()) { it->co.destroy(); it->co = nullptr; }
+		// adds an input node holding init
+		template<typename T>
+		input<std::decay_t<T>> &make_input(T &&init)
+		{
+			nodes.emplace_back(new input<std::decay_t<T>>(*this, std::forward<T>(init)));
+			return static_cast<input<std::decay_t<T>>&>(*nodes.back());
+		}
+		// adds a derived node computed by fn(context&), which must return a lazy_task<T> - fn is not run until the node is first evaluated
+		template<typename F, typename T = typename _lazy_result<std::invoke_result_t<F&, context&>>::type>
+		derived<T> &make_derived(F &&fn)
+		{
+			static_assert(!std::is_reference_v<T>, "derived nodes must produce values");
+			nodes.emplace_back(new derived<T>(std::forward<F>(fn)));
+			return static_cast<derived<T>&>(*nodes.back());
+		}
 
-					// we're done now - no longer need the coroutine handle.
-					// null the raw pointer we have so that the destructor won't try to wait() again
-					it = nullptr;
-				}
+		// brings a derived node up to date on the calling thread and returns its value - the reference is valid until the next change of an input.
+		// if a computation throws, the exception is propagated (the nodes it affected are re-run by the next evaluation).
+		template<typename T>
+		const T &get(derived<T> &n) { _verify(n); return *n.memo; }
 
-			public: // -- ctor / dtor / asgn -- //
+		// returns an awaitable which brings a derived node up to date and yields its value (see get()) - e.g. co_await graph.evaluate(pool, n).
+		// the out of date part of the graph recorded by the previous runs is verified level by level on pool, so independent dirty nodes are re-run in parallel
+		// (unlike get(), this may also verify dependencies which the new runs no longer read).
+		// each re-run is started on a pool worker and never waited for there - if the computation parks, the worker moves on and whoever unparks it drives it to completion.
+		// nodes only reached through dependencies which are new in this revision are brought up to date by the computation reading them.
+		template<typename T>
+		evaluate_awaitable<T> evaluate(thread_pool &pool, derived<T> &n) { return evaluate_awaitable<T>{ pool, *this, n }; }
+	};
 
-				// blocks and advances the stored iterator to the next yield value
-				~pseudo_iterator()
-				{
-					if (it) wait();
-				}
+#ifdef COUTIL_PROFILE
+	// ----------------------- //
 
-				pseudo_iterator(const pseudo_iterator&) = delete;
-				pseudo_iterator &operator=(const pseudo_iterator&) = delete;
+	// -- sampling profiler -- //
 
-				// passes on the responsibility for advancing the stored iterator to a new pseudo_iterator.
-				pseudo_iterator(pseudo_iterator &&other) : it(std::exchange(other.it, nullptr)) {}
-				pseudo_iterator &operator=(pseudo_iterator&&) = delete;
+	// ----------------------- //
 
-			public: // -- await interface -- //
+	// profiler periodically samples the running coroutine stack of threads (see COUTIL_PROFILE).
+	// each frame of a sample is a logical coroutine (its category and address) rather than the resume() machinery which happens to be running it.
+	// on linux, a process cpu-time timer (timer_create()) sends SIGPROF, and the handler samples the stack of the thread it interrupted - so samples follow where cpu time is spent.
+	// the profiler then takes over SIGPROF (the handler stays installed afterwards), and only one profiler at a time can use the timer - others fall back to polling.
+	// elsewhere, a background thread polls the stack of every thread which is running a coroutine - a stack is read under its sequence counter, so a sample never mixes frames from before and after a push or pop
+	// (a thread which keeps changing its stack during the read is skipped for that tick).
+	// samples are recorded into a fixed-capacity buffer without locking out readers - once it is full, further samples are dropped.
+	// threads which are not running a coroutine at the time of a sample are not recorded.
+	class profiler
+	{
+	private: // -- private utility info -- //
 
-				bool await_ready() { return done(); }
-				void await_suspend(std::experimental::coroutine_handle<>) {}
-				void await_result() { wait(); }
-			};
+		static inline constexpr std::size_t max_depth = detail::_thread_slot::max_depth;
 
-		public: // -- iterator traits -- //
+		struct sample
+		{
+			std::size_t thread;               // the index of the sampled thread
+			std::size_t depth;                // the (total) number of nested coroutines
+			const void *frames[max_depth];    // coroutine addresses (outermost first)
+			const char *categories[max_depth];
+		};
+		struct stored
+		{
+			sample            value;
+			std::atomic<bool> ready{ false }; // set once value is written
+		};
 
-			typedef std::input_iterator_tag iterator_category;
-			typedef T                       value_type;
-			typedef std::ptrdiff_t          difference_type;
-			typedef T                      *pointer_type;
-			typedef T                      &reference_type;
+	private: // -- data -- //
 
-		private: // -- data -- //
+		std::unique_ptr<stored[]> samples;
+		const std::size_t         capacity;
+		std::atomic<std::size_t>  claimed{ 0 }; // number of stored samples taken by samplers (may exceed capacity)
+		std::atomic<std::size_t>  count{ 0 };   // number of published samples
+		std::atomic<std::size_t>  dropped{ 0 }; // number of samples dropped due to the buffer being full
 
-			handle co; // the raw coroutine handle (from the generator)
+		std::mutex                mutex;
+		std::condition_variable   cv;           // signalled on stop
+		bool                      stopping = false;
+		std::thread               sampler;
 
-		private: // -- private util -- //
+#if defined(__linux__)
+		timer_t                   timer;
+		bool                      timed = false; // true while timer is armed for this profiler
 
-			friend class basic_generator;
+		static inline std::atomic<profiler*>   active{ nullptr };  // the profiler which owns the timer signal
+		static inline std::atomic<std::size_t> in_handler{ 0 };    // number of signal handlers currently running
+#endif
 
-			explicit iterator(handle h) : co(std::move(h))
+	private: // -- private util -- //
+
+		// publishes a sample - only touches atomics and the claimed stored sample, so it is safe to call from a signal handler
+		void _publish(const sample &smp)
+		{
+			std::size_t n = claimed.fetch_add(1, std::memory_order_relaxed);
+			if (n >= capacity) { dropped.fetch_add(1, std::memory_order_relaxed); return; }
+
+			samples[n].value = smp;
+			samples[n].ready.store(true, std::memory_order_release);
+			count.fetch_add(1, std::memory_order_release);
+		}
+
+		// copies the coroutine stack of a thread into smp - returns false if the copy overlapped a push or pop
+		static bool _try_copy(const detail::_thread_slot &slot, sample &smp)
+		{
+			std::size_t s = slot.seq.load(std::memory_order_acquire);
+			if (s & 1) return false;
+
+			smp.thread = slot.index;
+			smp.depth = slot.depth.load(std::memory_order_relaxed);
+			for (std::size_t i = 0; i < smp.depth && i < max_depth; ++i)
 			{
-				// if we have a good coroutine, advance once to get the first value
-				if (co) ++*this;
+				smp.frames[i] = slot.frames[i].load(std::memory_order_relaxed);
+				smp.categories[i] = slot.categories[i].load(std::memory_order_relaxed);
 			}
 
-		public: // -- ctor / dtor / asgn -- //
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return slot.seq.load(std::memory_order_relaxed) == s;
+		}
 
-			iterator() = default;
+		void _sample_all()
+		{
+			detail::_slot_registry &reg = detail::_slot_registry::get();
+			std::lock_guard<std::mutex> lock(reg.mutex);
 
-			~iterator() { if (co) co.destroy(); }
+			for (const detail::_thread_slot *slot = reg.head; slot; slot = slot->next)
+			{
+				if (slot->depth.load(std::memory_order_relaxed) == 0) continue;
 
-			iterator(const iterator&) = delete;
-			iterator &operator=(const iterator&) = delete;
+				// retry a copy which overlapped a push or pop a few times before skipping the thread
+				sample smp;
+				for (int attempt = 0; attempt < 4; ++attempt)
+				{
+					if (_try_copy(*slot, smp)) { if (smp.depth != 0) _publish(smp); break; }
+					std::this_thread::yield();
+				}
+			}
+		}
 
-			// steals the iteration handle from other - other is "empty" after this.
-			iterator(iterator &&other) : co(std::exchange(other.co, nullptr)) {}
-			// discards the current iterator handle and steals other's - other is "empty" after this.
-			// self assignment is no-op.
-			iterator &operator=(iterator &&other) { co = std::exchange(other.co, nullptr); return *this; }
+#if defined(__linux__)
+		// SIGPROF handler - samples the interrupted thread.
+		// the thread cannot change its own stack while the handler runs, so a copy is only inconsistent if the signal arrived in the middle of a push or pop (the sample is then skipped).
+		static void _on_signal(int)
+		{
+			in_handler.fetch_add(1, std::memory_order_seq_cst);
+			if (profiler *p = active.load(std::memory_order_seq_cst))
+			{
+				const detail::_thread_slot *slot = detail::_signal_thread_slot();
+				sample smp;
+				if (slot && slot->depth.load(std::memory_order_relaxed) != 0 && _try_copy(*slot, smp) && smp.depth != 0) p->_publish(smp);
+			}
+			in_handler.fetch_sub(1, std::memory_order_release);
+		}
 
-		public: // -- iterator interface -- //
+		// starts sampling on SIGPROF every interval of process cpu time - returns false if the timer is not available (e.g. another profiler is using it)
+		bool _start_timer(std::chrono::steady_clock::duration interval)
+		{
+			profiler *expected = nullptr;
+			if (!active.compare_exchange_strong(expected, this, std::memory_order_seq_cst)) return false;
 
-			// gets the currently-stored (most-recently-yielded) value.
-			// if an exception caused the coroutine to end prematurely, rethrows the exception.
-			const T &operator*() const&
+			static const bool installed = []
 			{
-				// if we have an exception, rethrow it
-				if (auto ex = std::get_if<0>(&co.promise().stat); ex && *ex) std::rethrow_exception(*ex);
+				struct sigaction sa = {};
+				sa.sa_handler = &_on_signal;
+				sa.sa_flags = SA_RESTART;
+				sigemptyset(&sa.sa_mask);
+				return sigaction(SIGPROF, &sa, nullptr) == 0;
+			}();
 
-				return std::get<1>(co.promise().stat);
+			std::int64_t ns = std::max<std::int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count());
+			struct itimerspec spec = {};
+			spec.it_interval.tv_sec = (time_t)(ns / 1000000000);
+			spec.it_interval.tv_nsec = (long)(ns % 1000000000);
+			spec.it_value = spec.it_interval;
+
+			struct sigevent ev = {};
+			ev.sigev_notify = SIGEV_SIGNAL;
+			ev.sigev_signo = SIGPROF;
+			if (installed && timer_create(CLOCK_PROCESS_CPUTIME_ID, &ev, &timer) == 0)
+			{
+				if (timer_settime(timer, 0, &spec, nullptr) == 0) return timed = true;
+				timer_delete(timer);
 			}
-			T operator*() &&
+			active.store(nullptr, std::memory_order_seq_cst);
+			return false;
+		}
+		// disarms the timer and waits for running handlers - once this returns, no further samples are published
+		void _stop_timer()
+		{
+			if (!timed) return;
+			timed = false;
+			timer_delete(timer);
+			active.store(nullptr, std::memory_order_seq_cst);
+			while (in_handler.load(std::memory_order_seq_cst)) std::this_thread::yield();
+		}
+#endif
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// starts sampling every interval, keeping at most max_samples samples
+		explicit profiler(std::chrono::steady_clock::duration interval = std::chrono::milliseconds(1), std::size_t max_samples = 1 << 14)
+			: samples(new stored[max_samples]), capacity(max_samples)
+		{
+#if defined(__linux__)
+			if (_start_timer(interval)) return;
+#endif
+			sampler = std::thread([this, interval]
 			{
-				// if we have an exception, rethrow it
-				if (auto ex = std::get_if<0>(&co.promise().stat); ex && *ex) std::rethrow_exception(*ex);
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!cv.wait_for(lock, interval, [this] { return stopping; })) _sample_all();
+			});
+		}
 
-				return std::move(std::get<1>(co.promise().stat));
-			}
+		// stops sampling
+		~profiler() { stop(); }
 
-			// advances to the next yield value.
-			// this can be performed asyncronously with co_await.
-			// otherwise the destruction of the pseudo_iterator performs the operation synchronously.
-			// exceptions from this action are propagated through the dereferencing operator.
-			pseudo_iterator operator++() &
+		profiler(const profiler&) = delete;
+		profiler &operator=(const profiler&) = delete;
+
+	public: // -- interface -- //
+
+		// stops sampling - the recorded samples remain available. does nothing if already stopped.
+		void stop()
+		{
+#if defined(__linux__)
+			_stop_timer();
+#endif
 			{
-				// make sure we have a valid (non-null) coroutine handle
-				if (!co) throw std::invalid_argument("Attempt to increment past end iterator");
-				return pseudo_iterator{*this};
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
 			}
-			pseudo_iterator operator++() && = delete;
+			cv.notify_all();
+			if (sampler.joinable()) sampler.join();
+		}
 
-			friend bool operator==(const iterator &a, const iterator &b)
+		// returns the number of samples recorded so far
+		std::size_t sample_count() const { return count.load(std::memory_order_acquire); }
+		// returns the number of samples which were dropped because the buffer was full
+		std::size_t dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+
+		// writes the samples recorded so far in folded-stack format (one "frame;frame;... count" line per distinct stack).
+		// each stack starts with the thread, followed by each coroutine as its category (or "coroutine" if it has none), so the samples of all coroutines of a category fold together.
+		// if addresses is true, each coroutine is written as category@address instead, which keeps the individual coroutines apart.
+		void write_folded(std::ostream &os, bool addresses = false) const
+		{
+			std::map<std::string, std::size_t> stacks;
+			for (std::size_t i = 0, n = std::min(claimed.load(std::memory_order_acquire), capacity); i < n; ++i)
 			{
-				// iterator is a uniquely-owning type, so the only way they can be equal is if they're both invalid (end) iterators
-				return !a.co && !b.co;
-			}
-			friend bool operator!=(const iterator &a, const iterator &b) { return !(a == b); }
-		};
+				if (!samples[i].ready.load(std::memory_order_acquire)) continue;
+				const sample &smp = samples[i].value;
 
-		// gets the begin iterator of this generator.
-		// this operation steals the coroutine handle from this object - i.e. the generator is empty after this operation.
-		// if the generator is currently empty, returns the end iterator.
-		iterator begin() { return iterator{ std::exchange(co, nullptr) }; }
-		// returns the end iterator for this generator - this generator is not modified by this action.
-		iterator end() const { return iterator{}; }
-	};
+				std::ostringstream stack;
+				stack << "thread-" << smp.thread;
+				for (std::size_t j = 0; j < smp.depth && j < max_depth; ++j)
+				{
+					stack << ';' << (smp.categories[j] ? smp.categories[j] : "coroutine");
+					if (addresses) stack << '@' << smp.frames[j];
+				}
+				if (smp.depth > max_depth) stack << ";...";
 
-	template<typename T>
-	using generator = basic_generator<T>;
+				++stacks[stack.str()];
+			}
+			for (const auto &entry : stacks) os << entry.first << ' ' << entry.second << '\n';
+		}
+	};
+#endif
 }
 
 #endif
@@ -3,8 +3,21 @@
 #include <stdexcept>
 #include <type_traits>
 #include <cassert>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <sstream>
 #include <experimental/coroutine>
 
+#define COUTIL_PROFILE
+#define COUTIL_TRACE
+#define COUTIL_METRICS
+#define COUTIL_BACKTRACE
+#define COUTIL_FRAME_BUDGET
+#define COUTIL_DEADLOCK
+#define COUTIL_RCU
 #include "coutil.h"
 
 using namespace coutil;
@@ -27,6 +40,55 @@ using namespace coutil;
                              catch (const std::exception &e) { std::cerr << "LINE " STR(__LINE__) " THREW: " #expr "\nCAUSE: " << e.what() << '\n'; std::terminate(); } \
                              catch (...) { std::cerr << "LINE " STR(__LINE__) " THREW: " #expr "\n"; std::terminate(); }
 
+// a sender which completes synchronously with set_value(value)
+template<typename T>
+struct just_sender
+{
+	typedef coutil::completion_signatures<set_value_t(T)> completion_signatures;
+	T value;
+
+	template<typename R>
+	struct operation { T value; R r; void start() noexcept { r.set_value(std::forward<T>(value)); } };
+	template<typename R>
+	operation<R> connect(R r) && { return { std::forward<T>(value), std::move(r) }; }
+};
+// a sender which completes with set_value(value) on another thread
+struct thread_sender
+{
+	typedef coutil::completion_signatures<set_value_t(int)> completion_signatures;
+	int value;
+
+	template<typename R>
+	struct operation
+	{
+		int value; R r; std::thread t;
+		void start() noexcept { t = std::thread([this] { std::this_thread::sleep_for(std::chrono::milliseconds(10)); r.set_value(value); }); }
+		~operation() { if (t.joinable()) t.join(); }
+	};
+	template<typename R>
+	operation<R> connect(R r) && { return { value, std::move(r), {} }; }
+};
+// a sender which completes synchronously with set_stopped() or set_error(6)
+struct failing_sender
+{
+	typedef coutil::completion_signatures<set_error_t(int), set_stopped_t()> completion_signatures;
+	bool stop;
+
+	template<typename R>
+	struct operation { bool stop; R r; void start() noexcept { if (stop) r.set_stopped(); else r.set_error(6); } };
+	template<typename R>
+	operation<R> connect(R r) && { return { stop, std::move(r) }; }
+};
+// a receiver which records how it was completed
+struct recording_receiver
+{
+	int *value; int *how;
+	void set_value(int v) noexcept { *value = v; *how = 1; }
+	void set_value() noexcept { *how = 1; }
+	void set_error(std::exception_ptr) noexcept { *how = 2; }
+	void set_stopped() noexcept { *how = 3; }
+};
+
 int main() try
 {
 	static_assert(std::is_same_v<task<void>, task<const void>>);
@@ -125,6 +187,99 @@ int main() try
 	assert_throws([]() -> task<> { throw 6; co_return; }().wait(), int);
 	assert_throws([]() -> lazy_task<> { throw 6; co_return; }().wait(), int);
 
+	{
+		static_assert(sizeof(any_task) == 2 * sizeof(void*));
+		static_assert(is_task_v<any_task> && is_task_v<const any_awaitable<int>>);
+
+		any_task a;
+		assert(a.empty() && !a && !static_cast<bool>(a));
+		assert_throws(a.done(), bad_coroutine_access);
+		assert_throws(a.wait(), bad_coroutine_access);
+
+		int val = 0;
+		std::vector<any_task> tasks;
+		tasks.emplace_back([](int &v) -> lazy_task<> { v += 1; co_return; }(val));
+		tasks.emplace_back([](int &v) -> task<int> { co_await std::experimental::suspend_always{}; v += 10; co_return v; }(val));
+		tasks.emplace_back([](int &v) -> lazy_task<double> { v += 100; co_return 2.5; }(val));
+		assert(val == 0);
+
+		for (any_task &t : tasks) { assert(!t.empty()); t.resume(); }
+		for (any_task &t : tasks) t.wait();
+		assert(val == 111);
+		for (any_task &t : tasks) assert(t.empty());
+
+		any_awaitable<int> b = [](int a, int b) -> lazy_task<int> { co_return a * b; }(6, 7);
+		any_awaitable<int> c = std::move(b);
+		assert(b.empty() && !c.empty() && !c.done());
+		assert(c.wait() == 42);
+		assert(c.empty());
+
+		any_awaitable<int&> d = [](int &v) -> task<int&> { co_return v; }(val);
+		assert(&d.wait() == &val);
+
+		any_task e = []() -> lazy_task<int> { throw 6; co_return 77; }();
+		assert_throws(e.wait(), int);
+		assert(e.empty());
+
+		auto outer = [](any_awaitable<int> inner) -> task<int> { co_return 1 + co_await inner; }([]() -> lazy_task<int> { co_return 5; }());
+		assert(outer.wait() == 6);
+	}
+
+	{
+		static_assert(std::is_same_v<detail::_sender_value_t<task_sender<int, std::experimental::suspend_always>>, int>);
+		static_assert(std::is_same_v<detail::_sender_value_t<task_sender<void, std::experimental::suspend_never>>, void>);
+		static_assert(std::is_same_v<detail::_sender_value_t<failing_sender>, void>);
+
+		int value = 0, how = 0;
+		auto op = as_sender([]() -> lazy_task<int> { co_return 17; }()).connect(recording_receiver{ &value, &how });
+		assert(how == 0);
+		op.start(); // runs the task inline
+		assert(how == 1 && value == 17);
+
+		auto op2 = as_sender([]() -> task<> { throw 6; co_return; }()).connect(recording_receiver{ &value, &how });
+		op2.start();
+		assert(how == 2);
+
+		auto op3 = as_sender(lazy_task<>{}).connect(recording_receiver{ &value, &how });
+		how = 0;
+		op3.start();
+		assert(how == 2);
+
+		// start() returns once the task parks - the thread which sends the value resumes the task and completes the receiver
+		auto [tx, rx] = oneshot<int>::make();
+		how = 0;
+		std::thread::id completed_on;
+		auto op4 = as_sender([](oneshot<int>::receiver rx, std::thread::id &on) -> lazy_task<int> { int v = co_await rx; on = std::this_thread::get_id(); co_return v; }(std::move(rx), completed_on)).connect(recording_receiver{ &value, &how });
+		op4.start();
+		assert(how == 0);
+		std::thread th([](oneshot<int>::sender tx) { tx.set_value(23); }, std::move(tx));
+		std::thread::id sender_id = th.get_id();
+		th.join();
+		assert(how == 1 && value == 23 && completed_on == sender_id);
+	}
+	{
+		task<int> a = []() -> task<int> { co_return co_await as_awaitable(just_sender<int>{ 5 }); }();
+		assert(a.done() && a.wait() == 5);
+
+		task<std::string> b = []() -> task<std::string> { auto hello = as_awaitable(just_sender<std::string>{ "hello" }); co_return co_await hello + " world"; }();
+		assert(b.wait() == "hello world");
+
+		int val = 0;
+		task<int&> c = [](int &v) -> task<int&> { co_return co_await as_awaitable(just_sender<int&>{ v }); }(val);
+		assert(&c.wait() == &val);
+
+		task<int> d = []() -> task<int> { co_return 1 + co_await as_awaitable(as_sender([]() -> lazy_task<int> { co_return 2; }())); }();
+		assert(d.wait() == 3);
+
+		task<int> e = []() -> task<int> { co_return co_await as_awaitable(thread_sender{ 12 }); }();
+		assert(!e.done());
+		e.resume(); // parked - must not be resumed
+		assert(e.wait() == 12);
+
+		assert_throws([]() -> task<> { co_await as_awaitable(failing_sender{ true }); }().wait(), operation_stopped);
+		assert_throws([]() -> task<> { co_await as_awaitable(failing_sender{ false }); }().wait(), int);
+	}
+
 	{
 		generator<int> gen123 = []() -> generator<int> { co_yield 1; co_yield 2; co_yield 3; }();
 		auto beg = gen123.begin();
@@ -189,6 +344,1037 @@ int main() try
 		}
 	}
 
+	{
+		auto nums = [](int start) -> generator<int> { for (int i = start; i < start + 3; ++i) co_yield i; };
+		auto slow = []() -> generator<int> { co_yield co_await as_awaitable(thread_sender{ 100 }); co_yield co_await as_awaitable(thread_sender{ 101 }); };
+
+		std::vector<std::pair<std::size_t, int>> got;
+		for (const auto &v : merge_ready(slow(), nums(0), generator<int>{}, nums(10))) got.push_back(v);
+
+		// the parked source only produces after the others are exhausted
+		assert(got.size() == 8);
+		assert(got[6] == std::make_pair(std::size_t(0), 100) && got[7] == std::make_pair(std::size_t(0), 101));
+		std::vector<int> from1, from3;
+		for (const auto &v : got) if (v.first == 1) from1.push_back(v.second); else if (v.first == 3) from3.push_back(v.second);
+		assert((from1 == std::vector<int>{ 0, 1, 2 }) && (from3 == std::vector<int>{ 10, 11, 12 }));
+
+		task<int> sum = [](generator<std::pair<std::size_t, int>> merged) -> task<int>
+		{
+			int res = 0;
+			for (auto it = merged.begin(), end = merged.end(); it != end; co_await ++it) res += (*it).second;
+			co_return res;
+		}(merge_ready(nums(1), slow()));
+		assert(sum.wait() == 1 + 2 + 3 + 100 + 101);
+
+		// with no source runnable the merged generator parks, and the source being unparked wakes whoever waits on it
+		auto [tx, rx] = oneshot<int>::make();
+		task<std::vector<int>> consumer = [](generator<std::pair<std::size_t, int>> merged) -> task<std::vector<int>>
+		{
+			std::vector<int> res;
+			auto it = merged.begin();
+			res.push_back((*it).second);
+			while (next_result<std::pair<std::size_t, int>> r = co_await it.next_until(timer_service::clock::time_point::max())) res.push_back(r.value->second);
+			co_return res;
+		}(merge_ready([](oneshot<int>::receiver rx) -> generator<int> { co_yield co_await rx; }(std::move(rx)), nums(7)));
+		for (int i = 0; i < 3; ++i) consumer.resume();
+		assert(!consumer.done());
+		tx.set_value(20);
+		assert((consumer.wait() == std::vector<int>{ 7, 8, 9, 20 }));
+
+		// the last sources are unparked from other threads while the merged generator is going to sleep - the merge then ends and is destroyed right away
+		for (int round = 0; round < 1000; ++round)
+		{
+			auto [tx1, rx1] = oneshot<int>::make();
+			auto [tx2, rx2] = oneshot<int>::make();
+			auto complete = [](oneshot<int>::sender tx, int value, int spin) { for (std::atomic<int> i{ 0 }; i.load(std::memory_order_relaxed) < spin; i.fetch_add(1, std::memory_order_relaxed)) {} tx.set_value(value); };
+			std::thread th1(complete, std::move(tx1), 1, round % 32 * 16);
+			std::thread th2(complete, std::move(tx2), 2, round % 48 * 16);
+			auto source = [](oneshot<int>::receiver rx) -> generator<int> { co_yield co_await rx; };
+			task<int> sum = [](generator<std::pair<std::size_t, int>> merged) -> task<int>
+			{
+				int res = 0;
+				for (auto it = merged.begin(), end = merged.end(); it != end; co_await ++it) res += (*it).second;
+				co_return res;
+			}(merge_ready(source(std::move(rx1)), source(std::move(rx2))));
+			assert(sum.wait() == 3);
+			th1.join();
+			th2.join();
+		}
+	}
+
+	{
+		std::atomic<int> count{ 0 };
+		{
+			thread_pool pool(4);
+
+			std::vector<lazy_task<>> tasks;
+			for (int i = 0; i < 1000; ++i) tasks.push_back([](std::atomic<int> &c) -> lazy_task<> { c.fetch_add(1); co_return; }(count));
+			pool.schedule_bulk(tasks.begin(), tasks.end());
+			for (auto &t : tasks) assert(t.empty());
+			pool.wait();
+			assert(count == 1000);
+
+			// parking (rescheduled once unparked) and polling (nested lazy_task) coroutines
+			std::vector<lazy_task<int>> mixed;
+			for (int i = 0; i < 8; ++i) mixed.push_back([](std::atomic<int> &c) -> lazy_task<int> { c += co_await as_awaitable(thread_sender{ 2 }); co_return 0; }(count));
+			for (int i = 0; i < 8; ++i) mixed.push_back([](std::atomic<int> &c) -> lazy_task<int> { c += co_await []() -> lazy_task<int> { co_return 3; }(); co_return 0; }(count));
+			pool.schedule_bulk(mixed.begin(), mixed.end());
+			pool.wait();
+			assert(count == 1000 + 8 * 2 + 8 * 3);
+
+			pool.schedule([]() -> lazy_task<int> { throw 6; co_return 0; }());
+			assert_throws(pool.wait(), int);
+			assert_nothrow(pool.wait());
+
+			lazy_task<> empty;
+			assert_throws(pool.schedule(std::move(empty)), bad_coroutine_access);
+
+			pool.schedule([](std::atomic<int> &c) -> lazy_task<> { co_await as_awaitable(thread_sender{ 0 }); c += 1; }(count));
+		}
+		assert(count == 1000 + 8 * 2 + 8 * 3 + 1); // the destructor waits for outstanding coroutines
+	}
+
+	{
+		task<int> a = [](std::thread::id self) -> task<int>
+		{
+			std::thread::id other = co_await offload([] { std::this_thread::sleep_for(std::chrono::milliseconds(5)); return std::this_thread::get_id(); });
+			assert(other != self && std::this_thread::get_id() == self);
+			co_return 4;
+		}(std::this_thread::get_id());
+		assert(a.wait() == 4);
+
+		int val = 0;
+		task<int&> b = [](int &v) -> task<int&> { co_return co_await offload([&v]() -> int& { return v; }); }(val);
+		assert(&b.wait() == &val);
+
+		assert_throws([]() -> task<> { co_await offload([] { throw 6; }); }().wait(), int);
+
+		std::atomic<int> count{ 0 };
+		blocking_pool blocking(2);
+		thread_pool pool(2);
+		std::vector<lazy_task<>> tasks;
+		for (int i = 0; i < 8; ++i) tasks.push_back([](blocking_pool &bp, std::atomic<int> &c) -> lazy_task<> { c += co_await offload(bp, [] { std::this_thread::sleep_for(std::chrono::milliseconds(5)); return 1; }); }(blocking, count));
+		pool.schedule_bulk(tasks.begin(), tasks.end());
+		pool.wait();
+		assert(count == 8);
+	}
+
+	{
+		assert(current_coroutine() == nullptr);
+		assert([]() -> lazy_task<const void*> { co_return current_coroutine(); }().wait() != nullptr);
+		assert(current_coroutine() == nullptr);
+
+		profiler prof(std::chrono::microseconds(200));
+
+		lazy_task<> spin = []() -> lazy_task<> { for (auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(30); std::chrono::steady_clock::now() < end; ); co_return; }();
+		spin.set_category("spinner");
+		lazy_task<> outer = [](lazy_task<> inner) -> lazy_task<> { co_await inner; }(std::move(spin));
+		outer.set_category("outer");
+		outer.wait();
+
+		prof.stop();
+		std::size_t samples = prof.sample_count();
+		assert(samples > 0 && prof.dropped_count() == 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		assert(prof.sample_count() == samples);
+
+		std::ostringstream folded;
+		prof.write_folded(folded);
+		assert(folded.str().find(";outer;spinner ") != std::string::npos && folded.str().find('@') == std::string::npos);
+		std::ostringstream detailed;
+		prof.write_folded(detailed, true);
+		assert(detailed.str().find(";outer@") != std::string::npos && detailed.str().find(";spinner@") != std::string::npos);
+	}
+
+	{
+		async_mutex m;
+		async_condition_variable cv;
+		std::vector<int> queue;
+		int sum = 0;
+
+		lazy_task<> consumer = [](async_mutex &m, async_condition_variable &cv, std::vector<int> &q, int &sum) -> lazy_task<>
+		{
+			async_lock lock = co_await m.scoped_lock();
+			for (int received = 0; received < 3; ++received)
+			{
+				co_await cv.wait(lock, [&q] { return !q.empty(); });
+				assert(lock.owns_lock());
+				sum += q.back();
+				q.pop_back();
+			}
+		}(m, cv, queue, sum);
+		lazy_task<> producer = [](async_mutex &m, async_condition_variable &cv, std::vector<int> &q) -> lazy_task<>
+		{
+			for (int i = 1; i <= 3; ++i)
+			{
+				co_await m.lock();
+				q.push_back(i);
+				m.unlock();
+				cv.notify_one();
+				co_await std::experimental::suspend_always{};
+			}
+		}(m, cv, queue);
+		wait_all(consumer, producer);
+		assert(sum == 1 + 2 + 3 && queue.empty() && m.try_lock());
+		m.unlock();
+
+		async_lock none;
+		assert_throws(cv.wait(none), std::invalid_argument);
+		assert_throws(none.unlock(), std::invalid_argument);
+
+		// contended counter and a barrier-like wait on a shared count, across threads
+		int counter = 0, arrived = 0;
+		{
+			thread_pool pool(4);
+			std::vector<lazy_task<>> tasks;
+			for (int i = 0; i < 16; ++i) tasks.push_back([](async_mutex &m, async_condition_variable &cv, int &counter, int &arrived) -> lazy_task<>
+			{
+				for (int j = 0; j < 100; ++j)
+				{
+					async_lock lock = co_await m.scoped_lock();
+					++counter;
+				}
+				async_lock lock = co_await m.scoped_lock();
+				if (++arrived == 16) cv.notify_all();
+				co_await cv.wait(lock, [&arrived] { return arrived == 16; });
+				assert(counter == 16 * 100);
+			}(m, cv, counter, arrived));
+			pool.schedule_bulk(tasks.begin(), tasks.end());
+			pool.wait();
+		}
+		assert(counter == 16 * 100 && arrived == 16);
+	}
+
+	{
+		auto [tx, rx] = oneshot<std::string>::make();
+		std::thread th([](oneshot<std::string>::sender tx) { std::this_thread::sleep_for(std::chrono::milliseconds(5)); tx.set_value("hello"); }, std::move(tx));
+		task<std::string> a = [](oneshot<std::string>::receiver rx) -> task<std::string> { co_return co_await rx; }(std::move(rx));
+		assert(a.wait() == "hello");
+		th.join();
+
+		oneshot<int> slot;
+		oneshot<int>::receiver r = slot.get_receiver();
+		{
+			oneshot<int>::sender s = slot.get_sender();
+			s.set_value(6);
+			assert(s.empty());
+			assert_throws(s.set_value(7), bad_coroutine_access);
+		}
+		assert(r.ready());
+		assert([](oneshot<int>::receiver &r) -> task<int> { co_return co_await r; }(r).wait() == 6);
+
+		auto [tx2, rx2] = oneshot<void>::make();
+		{ oneshot<void>::sender dropped = std::move(tx2); }
+		assert_throws([](oneshot<void>::receiver &r) -> task<> { co_await r; }(rx2).wait(), broken_promise);
+
+		auto [tx3, rx3] = oneshot<int&>::make();
+		int val = 0;
+		tx3.set_value(val);
+		assert(&[](oneshot<int&>::receiver &r) -> task<int&> { co_return co_await r; }(rx3).wait() == &val);
+	}
+
+	{
+		watch<int> w(1);
+		assert(w.get() == 1 && w.version() == 0);
+
+		lazy_task<int> reader = [](watch<int> &w) -> lazy_task<int>
+		{
+			std::uint64_t seen = 0;
+			int val = w.get(seen);
+			while (val != 3) val = co_await w.changed(seen);
+			co_return (int)seen;
+		}(w);
+		lazy_task<> writer = [](watch<int> &w) -> lazy_task<>
+		{
+			for (int i = 2; i <= 3; ++i) { co_await std::experimental::suspend_always{}; w.publish(i); }
+		}(w);
+		wait_all(reader, writer);
+		assert(reader.wait() == 2 && w.get() == 3);
+
+		// consistent snapshots under concurrent writes, and all waiters woken by one publish
+		struct pair_t { long long a, b, c; };
+		watch<pair_t> p({ 0, 0, 0 });
+		std::atomic<bool> done{ false };
+		std::thread writer_thread([&] { for (long long i = 1; i <= 20000; ++i) p.publish({ i, -i, 2 * i }); done = true; });
+		for (std::uint64_t v = 0; !done; )
+		{
+			pair_t x = p.get(v);
+			assert(x.b == -x.a && x.c == 2 * x.a && (std::uint64_t)x.a == v);
+		}
+		writer_thread.join();
+
+		std::atomic<int> woken{ 0 };
+		{
+			thread_pool pool(4);
+			std::vector<lazy_task<>> waiters;
+			for (int i = 0; i < 64; ++i) waiters.push_back([](watch<int> &w, std::atomic<int> &woken, std::uint64_t seen) -> lazy_task<> { if (co_await w.changed(seen) == 10) ++woken; }(w, woken, w.version()));
+			pool.schedule_bulk(waiters.begin(), waiters.end());
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			w.publish(10);
+			pool.wait();
+		}
+		assert(woken == 64);
+
+		// non-trivial values are published as shared snapshots
+		watch<std::vector<std::string>> members({ "a" });
+		std::shared_ptr<const std::vector<std::string>> before = members.snapshot();
+		lazy_task<std::size_t> membership = [](watch<std::vector<std::string>> &m) -> lazy_task<std::size_t>
+		{
+			std::uint64_t seen = 0;
+			std::vector<std::string> val = m.get(seen);
+			while (val.size() < 3) val = co_await m.changed(seen);
+			co_return val.size();
+		}(members);
+		std::thread member_writer([&members] { for (const char *name : { "b", "c" }) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); std::vector<std::string> next = members.get(); next.push_back(name); members.publish(std::move(next)); } });
+		assert(membership.wait() == 3);
+		member_writer.join();
+		std::uint64_t version;
+		assert((*before == std::vector<std::string>{ "a" }) && (*members.snapshot(version) == std::vector<std::string>{ "a", "b", "c" }) && version == 2);
+
+		watch<std::string> text("0");
+		std::thread text_writer([&text] { for (int i = 1; i <= 2000; ++i) text.publish(std::to_string(i)); });
+		for (std::uint64_t v = 0; v < 2000; )
+		{
+			std::string t = text.get(v);
+			assert(t == std::to_string(v));
+		}
+		text_writer.join();
+	}
+
+	{
+		using namespace trace;
+
+		// 4 single-segment tasks of 10ns on 2 cores
+		std::vector<event> synthetic;
+		for (std::uint64_t id = 1; id <= 4; ++id)
+		{
+			synthetic.push_back({ 0, id, 0, event_kind::spawn, 0 });
+			synthetic.push_back({ 0, id, 10, event_kind::run, (std::uint8_t)run_outcome::done });
+		}
+		// a task which parks for 100ns between two 10ns runs
+		synthetic.push_back({ 0, 5, 0, event_kind::spawn, 0 });
+		synthetic.push_back({ 0, 5, 10, event_kind::run, (std::uint8_t)run_outcome::parked });
+		synthetic.push_back({ 110, 5, 0, event_kind::wake, (std::uint8_t)wake_source::external });
+		synthetic.push_back({ 110, 5, 10, event_kind::run, (std::uint8_t)run_outcome::done });
+
+		report r = simulate(synthetic, fifo_policy{}, 2);
+		assert(r.tasks == 5 && r.makespan == 140 && r.p50 == 20 && r.p99 == 140);
+		r = simulate(synthetic, lifo_policy{}, 5);
+		assert(r.tasks == 5 && r.makespan == 120 && r.p50 == 10);
+
+		synthetic.push_back({ 200, 6, 0, event_kind::spawn, 0 });
+		synthetic.push_back({ 200, 6, 5'000'000'000, event_kind::run, (std::uint8_t)run_outcome::done }); // longer than 32-bit nanoseconds can hold
+		r = simulate(synthetic, fifo_policy{}, 6);
+		assert(r.tasks == 6 && r.makespan == 200 + 5'000'000'000 && r.p99 == 5'000'000'000);
+
+		std::stringstream bin;
+		write(bin, synthetic);
+		std::string bytes = bin.str();
+		assert(bytes.size() == 4 + 8 + 26 * synthetic.size() && bytes[4] == (char)synthetic.size() && bytes[5] == 0 && bytes[4 + 8] == (char)synthetic[0].time); // little endian fields
+		std::vector<event> back = read(bin);
+		assert(back.size() == synthetic.size() && back[10].time == 110 && back[10].kind == event_kind::wake && back[13].duration == 5'000'000'000);
+		std::stringstream junk("nope");
+		assert_throws(read(junk), std::invalid_argument);
+
+		// record a real run
+		recorder::global().restart();
+		{
+			thread_pool pool(2);
+			std::vector<lazy_task<>> tasks;
+			for (int i = 0; i < 4; ++i) tasks.push_back([]() -> lazy_task<> { co_await as_awaitable(thread_sender{ 1 }); co_await []() -> lazy_task<> { co_return; }(); }());
+			pool.schedule_bulk(tasks.begin(), tasks.end());
+			pool.wait();
+		}
+		std::vector<event> recorded = recorder::global().snapshot();
+		assert(std::count_if(recorded.begin(), recorded.end(), [](const event &e) { return e.kind == event_kind::spawn; }) == 4);
+		assert(std::count_if(recorded.begin(), recorded.end(), [](const event &e) { return e.kind == event_kind::wake; }) == 4);
+
+		// a sender completing synchronously unparks the coroutine before it has finished running (the unparker comes first in the handoff)
+		recorder::global().restart();
+		{
+			thread_pool pool(2);
+			std::vector<lazy_task<>> tasks;
+			for (int i = 0; i < 4; ++i) tasks.push_back([]() -> lazy_task<> { co_await as_awaitable(just_sender<int>{ 1 }); }());
+			pool.schedule_bulk(tasks.begin(), tasks.end());
+			pool.wait();
+		}
+		recorded = recorder::global().snapshot();
+		assert(std::count_if(recorded.begin(), recorded.end(), [](const event &e) { return e.kind == event_kind::wake && e.detail == (std::uint8_t)wake_source::worker; }) == 4);
+		report one = simulate(recorded, fifo_policy{}, 1), four = simulate(recorded, fifo_policy{}, 4);
+		assert(one.tasks == 4 && four.tasks == 4 && four.makespan <= one.makespan && one.p50 <= one.p99);
+	}
+
+	{
+		std::int64_t tasks = metrics::read(metrics::metric::live_tasks), frames = metrics::read(metrics::metric::frames_allocated), resumes = metrics::read(metrics::metric::resumes);
+		{
+			lazy_task<int> t = []() -> lazy_task<int> { co_return 1; }();
+			assert(metrics::read(metrics::metric::live_tasks) == tasks + 1 && metrics::read(metrics::metric::frames_allocated) == frames + 1);
+			t.wait();
+		}
+		assert(metrics::read(metrics::metric::live_tasks) == tasks && metrics::read(metrics::metric::resumes) > resumes);
+
+		metrics::park_totals sender_parks = metrics::read(metrics::primitive::sender), mutex_parks = metrics::read(metrics::primitive::async_mutex);
+		std::thread([] { assert([]() -> task<int> { co_return co_await as_awaitable(thread_sender{ 1 }); }().wait() == 1); }).join(); // shard of an exited thread
+		assert(metrics::read(metrics::primitive::sender).parks == sender_parks.parks + 1 && metrics::read(metrics::primitive::sender).wait_ns > sender_parks.wait_ns);
+		assert(metrics::read(metrics::primitive::async_mutex).parks == mutex_parks.parks); // waits are attributed to the primitive they were on
+		assert(metrics::read(metrics::metric::frames_allocated) == metrics::read(metrics::metric::frames_freed) + metrics::read(metrics::metric::live_tasks) + metrics::read(metrics::metric::live_generators));
+
+		std::ostringstream out;
+		metrics::write_openmetrics(out);
+		std::string text = out.str();
+		assert(text.find("# TYPE coutil_resumes counter\n") != std::string::npos && text.find("\ncoutil_resumes_total ") != std::string::npos);
+		assert(text.find("\ncoutil_pool_queued 0\n") != std::string::npos && text.find("\ncoutil_park_wait_seconds_count{primitive=\"sender\"} ") != std::string::npos);
+		assert(text.size() >= 6 && text.compare(text.size() - 6, 6, "# EOF\n") == 0);
+	}
+
+	{
+		auto [tx, rx] = oneshot<int>::make();
+		std::atomic<const void*> inner_frame{ nullptr };
+
+		lazy_task<int> inner = [](oneshot<int>::receiver rx, std::atomic<const void*> &f) -> lazy_task<int> { f = current_coroutine(); co_return co_await rx; }(std::move(rx), inner_frame);
+		inner.set_category("inner");
+		lazy_task<int> middle = [](lazy_task<int> inner) -> lazy_task<int> { co_return co_await inner; }(std::move(inner));
+		middle.set_category("middle");
+		lazy_task<int> outer = [](lazy_task<int> middle) -> lazy_task<int> { co_return co_await middle + 1; }(std::move(middle));
+		outer.set_category("outer");
+
+		std::thread th([&outer] { assert(outer.wait() == 10); });
+		while (!inner_frame) std::this_thread::yield();
+		std::vector<async_frame> bt;
+		while ((bt = async_backtrace(inner_frame.load())).empty() || !bt[0].parked) std::this_thread::yield();
+
+		assert(bt.size() == 3 && std::string(bt[0].category) == "inner" && std::string(bt[1].category) == "middle" && std::string(bt[2].category) == "outer");
+		assert(bt[0].site && bt[1].site && bt[2].site && bt[2].running);
+		assert(bt[1].site != bt[2].site); // each site lies in its own coroutine rather than in a shared helper
+
+		set_async_symbolizer([](const void*) -> std::string { return "sym"; });
+		std::ostringstream dump;
+		dump_suspended(dump);
+		assert(dump.str().find("#0 inner@") != std::string::npos && dump.str().find(" parked at sym\n#1 middle@") != std::string::npos);
+		set_async_symbolizer(nullptr);
+
+		tx.set_value(9);
+		th.join();
+		assert(async_backtrace(inner_frame.load()).empty());
+	}
+
+	{
+		// scalar reference scanner
+		auto reference = [](std::string_view rec)
+		{
+			std::vector<std::uint32_t> tape;
+			bool in = false;
+			for (std::size_t i = 0; i < rec.size(); ++i)
+			{
+				char c = rec[i];
+				if (in && c == '\\') { ++i; continue; }
+				if (c == '"') { in = !in; tape.push_back((std::uint32_t)i); }
+				else if (!in && std::string_view("{}[]:,").find(c) != std::string_view::npos) tape.push_back((std::uint32_t)i);
+			}
+			return tape;
+		};
+
+		std::string input = "{\"a\": [1, 2, {\"b\": \"x\\\"y\\n\"}]}\n\n";
+		input += "{\"long\": \"" + std::string(100, 'z') + "{\n}\\\\\", \"k\": null}\r\n";
+		input += "  [\"\\\\\\\"\", 3]";
+
+		std::vector<std::string> records;
+		for (const ndjson_record &r : ndjson_records(input))
+		{
+			records.emplace_back(r.text);
+			assert(std::vector<std::uint32_t>(r.structurals, r.structurals + r.structural_count) == reference(r.text));
+		}
+		assert(records.size() == 3);
+		assert(records[0] == "{\"a\": [1, 2, {\"b\": \"x\\\"y\\n\"}]}");
+		assert(records[1].size() == 100 + 28 && records[1].back() == '}');
+		assert(records[2] == "  [\"\\\\\\\"\", 3]");
+
+		// boundaries at every offset around a block edge
+		for (std::size_t pad = 50; pad < 80; ++pad)
+		{
+			std::string in = "{\"s\": \"" + std::string(pad, '\\') + (pad % 2 ? "\\" : "") + "\"}\n[1]";
+			std::size_t count = 0;
+			for (const ndjson_record &r : ndjson_records(in))
+			{
+				++count;
+				assert(std::vector<std::uint32_t>(r.structurals, r.structurals + r.structural_count) == reference(r.text));
+			}
+			assert(count == 2);
+		}
+		assert(ndjson_records("").begin() == ndjson_records("").end());
+	}
+
+	{
+		thread_pool pool(4);
+
+		std::vector<int> in(10007), out(in.size());
+		for (std::size_t i = 0; i < in.size(); ++i) in[i] = (int)((i * 7919) % 10007);
+
+		long long sum = 0;
+		lazy_task<> job = [](thread_pool &pool, std::vector<int> &in, std::vector<int> &out, long long &sum) -> lazy_task<>
+		{
+			auto end = co_await parallel_transform(pool, in, out.begin(), [](int x) { return x * 2; });
+			assert(end == out.end());
+			sum = co_await parallel_reduce(pool, out, 0LL, [](long long a, long long b) { return a + b; });
+			co_await parallel_sort(pool, out);
+		}(pool, in, out, sum);
+		pool.schedule(std::move(job)); // run from a pool worker - it parks rather than blocking the worker
+		pool.wait();
+
+		long long expected = 0;
+		for (int x : in) expected += 2LL * x;
+		assert(sum == expected && std::is_sorted(out.begin(), out.end()) && out.front() == 0 && out.back() == 2 * 10006);
+
+		// non-commutative reduction preserves order, and awaiting from outside the pool
+		std::vector<std::string> words(1000, "ab");
+		std::string joined = [](thread_pool &pool, std::vector<std::string> &w) -> task<std::string> { co_return co_await parallel_reduce(pool, w, std::string(">"), std::plus<>{}); }(pool, words).wait();
+		assert(joined.size() == 2001 && joined[0] == '>' && joined.substr(1, 4) == "abab");
+		assert([](thread_pool &pool, std::vector<int> &v) -> task<long long> { co_return co_await parallel_reduce(pool, v.begin(), v.begin(), 5LL, std::plus<>{}); }(pool, in).wait() == 5);
+
+		std::vector<double> big(100000);
+		for (std::size_t i = 0; i < big.size(); ++i) big[i] = (double)((i * 104729) % 100003);
+		[](thread_pool &pool, std::vector<double> &v) -> task<> { co_await parallel_sort(pool, v, std::greater<>{}); }(pool, big).wait();
+		assert(std::is_sorted(big.begin(), big.end(), std::greater<>{}));
+
+		assert_throws([](thread_pool &pool, std::vector<int> &v) -> task<> { co_await parallel_transform(pool, v, v.begin(), [](int x) -> int { if (x == 5) throw x; return x; }); }(pool, in).wait(), int);
+	}
+
+	{
+		auto start = std::chrono::steady_clock::now();
+		[]() -> task<> { co_await sleep_for(std::chrono::milliseconds(5)); }().wait();
+		assert(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(5));
+
+		// yields 1, then a value which takes 50ms to arrive, then 3
+		auto slow = []() -> generator<int>
+		{
+			co_yield 1;
+			co_yield co_await as_awaitable(thread_sender{ 50 });
+			co_await sleep_for(std::chrono::milliseconds(1));
+			co_yield 3;
+		};
+		lazy_task<std::vector<int>> consumer = [](generator<int> gen) -> lazy_task<std::vector<int>>
+		{
+			std::vector<int> got;
+			auto it = gen.begin();
+			got.push_back(*it);
+
+			int timeouts = 0;
+			for (;;)
+			{
+				next_result<int> r = co_await it.next_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(5));
+				if (r.status == next_status::end) break;
+				if (r.status == next_status::timeout) ++timeouts;
+				else got.push_back(*r.value);
+			}
+			assert(timeouts > 0 && it == gen.end());
+			co_return got;
+		}(slow());
+		assert(consumer.wait() == (std::vector<int>{ 1, 50, 3 }));
+
+		// a timed out advance is completed by a later increment
+		lazy_task<int> mixed = [](generator<int> gen) -> lazy_task<int>
+		{
+			auto it = gen.begin();
+			assert((co_await it.next_until(std::chrono::steady_clock::now())).status == next_status::timeout);
+			co_await ++it;
+			co_return *it;
+		}(slow());
+		assert(mixed.wait() == 50);
+	}
+
+	{
+		using namespace std::chrono_literals;
+
+		// the source parks twice before its next value - the consumer stays parked (rather than spinning) while the source waits again
+		auto [tx1, rx1] = oneshot<int>::make();
+		auto [tx2, rx2] = oneshot<int>::make();
+		std::atomic<int> stage{ 0 };
+		std::atomic<const void*> frame{ nullptr };
+		auto twice = [](oneshot<int>::receiver a, oneshot<int>::receiver b, std::atomic<int> &stage) -> generator<int>
+		{
+			co_yield 0;
+			int x = co_await a;
+			stage = 1;
+			int y = co_await b;
+			co_yield x + y;
+		};
+		lazy_task<int> consumer = [](generator<int> gen, std::atomic<const void*> &f) -> lazy_task<int>
+		{
+			f = current_coroutine();
+			auto it = gen.begin();
+			next_result<int> r = co_await it.next_until(std::chrono::steady_clock::now() + 10s);
+			co_return r.status == next_status::value ? *r.value : -1;
+		}(twice(std::move(rx1), std::move(rx2), stage), frame);
+
+		auto parked = [&frame] { std::vector<async_frame> bt = async_backtrace(frame.load()); return !bt.empty() && bt[0].parked; };
+		std::thread th([&consumer] { assert(consumer.wait() == 3); });
+		while (!parked()) std::this_thread::yield();
+		tx1.set_value(1);
+		while (stage == 0) std::this_thread::yield();
+		for (auto until = std::chrono::steady_clock::now() + 5s; !parked() && std::chrono::steady_clock::now() < until; ) std::this_thread::yield();
+		assert(parked());
+		tx2.set_value(2);
+		th.join();
+
+		// the deadline passes while the source is parked for the second time
+		auto [tx3, rx3] = oneshot<int>::make();
+		lazy_task<int> timed = [](generator<int> gen, oneshot<int>::sender tx) -> lazy_task<int>
+		{
+			auto it = gen.begin();
+			bool timed_out = (co_await it.next_until(std::chrono::steady_clock::now() + 30ms)).status == next_status::timeout;
+			tx.set_value(2);
+			next_result<int> r = co_await it.next_until(std::chrono::steady_clock::time_point::max());
+			co_return timed_out && r ? *r.value : -1;
+		}([](oneshot<int>::receiver b) -> generator<int> { co_yield 0; co_await sleep_for(5ms); co_yield co_await b; }(std::move(rx3)), std::move(tx3));
+		assert(timed.wait() == 2);
+
+		// the source is unparked from another thread while the consumer is (re)registering with it - the source then runs to its end and is destroyed right away
+		for (int round = 0; round < 2000; ++round)
+		{
+			auto [tx4, rx4] = oneshot<int>::make();
+			lazy_task<int> racing = [](generator<int> gen) -> lazy_task<int>
+			{
+				auto it = gen.begin();
+				int sum = *it;
+				for (;;)
+				{
+					next_result<int> r = co_await it.next_until(std::chrono::steady_clock::now() + 20us);
+					if (r.status == next_status::end) co_return sum;
+					if (r) sum += *r.value;
+				}
+			}([](oneshot<int>::receiver b) -> generator<int> { co_yield 1; co_yield co_await b; }(std::move(rx4)));
+			std::thread th([](oneshot<int>::sender tx, int spin) { for (std::atomic<int> i{ 0 }; i.load(std::memory_order_relaxed) < spin; i.fetch_add(1, std::memory_order_relaxed)) {} tx.set_value(2); }, std::move(tx4), round % 64 * 16);
+			assert(racing.wait() == 3);
+			th.join();
+		}
+	}
+
+	{
+		using namespace std::chrono_literals;
+
+		// bursts of 1 2 3, then 4 5, then 6 - separated by 60ms of quiet
+		auto bursts = []() -> generator<int>
+		{
+			co_yield 1; co_yield 2; co_yield 3;
+			co_await sleep_for(60ms);
+			co_yield 4; co_yield 5;
+			co_await sleep_for(60ms);
+			co_yield 6;
+		};
+		auto collect = [](auto gen) { std::vector<typename decltype(gen)::iterator::value_type> res; for (const auto &v : gen) res.push_back(v); return res; };
+
+		assert(collect(debounce(bursts(), 20ms)) == (std::vector<int>{ 3, 5, 6 }));
+		assert(collect(throttle(bursts(), 20ms)) == (std::vector<int>{ 1, 3, 4, 5, 6 }));
+		assert(collect(sample(bursts(), 30ms)) == (std::vector<int>{ 3, 5, 6 }));
+		assert(collect(buffer_time(bursts(), 20ms, 2)) == (std::vector<std::vector<int>>{ { 1, 2 }, { 3 }, { 4, 5 }, { 6 } }));
+		assert(collect(buffer_time(bursts(), 20ms, 10)) == (std::vector<std::vector<int>>{ { 1, 2, 3 }, { 4, 5 }, { 6 } }));
+
+		// operators compose, can be consumed asynchronously and propagate source exceptions
+		lazy_task<std::vector<int>> consumer = [](generator<int> gen) -> lazy_task<std::vector<int>>
+		{
+			std::vector<int> got;
+			for (auto it = gen.begin(); it != gen.end(); co_await ++it) got.push_back(*it);
+			co_return got;
+		}(debounce(throttle(bursts(), 5ms), 20ms));
+		assert(consumer.wait() == (std::vector<int>{ 3, 5, 6 }));
+
+		assert(collect(debounce(generator<int>{}, 1ms)).empty());
+		auto failing = []() -> generator<int> { co_yield 1; co_await sleep_for(5ms); throw 7; };
+		assert_throws([](generator<int> gen) -> task<> { for (auto it = gen.begin(); co_await it.next_until(std::chrono::steady_clock::time_point::max()); ); }(sample(failing(), 1ms)).wait(), int);
+		assert_throws(collect(buffer_time(bursts(), 1ms, 0)), std::invalid_argument);
+	}
+
+	{
+		using namespace std::chrono_literals;
+
+		// the source parks three times between two values - the operator stays parked on it throughout (and so does a consumer parked on the operator)
+		auto [tx1, rx1] = oneshot<int>::make();
+		auto [tx2, rx2] = oneshot<int>::make();
+		auto [tx3, rx3] = oneshot<int>::make();
+		std::atomic<int> stage{ 0 };
+		std::atomic<const void*> frame{ nullptr };
+		auto source = [](oneshot<int>::receiver a, oneshot<int>::receiver b, oneshot<int>::receiver c, std::atomic<int> &stage) -> generator<int>
+		{
+			co_yield 0;
+			int x = co_await a;
+			stage = 1;
+			x += co_await b;
+			stage = 2;
+			x += co_await c;
+			co_yield x;
+		};
+		lazy_task<int> consumer = [](generator<int> gen, std::atomic<const void*> &f) -> lazy_task<int>
+		{
+			auto it = gen.begin();
+			int first = *it;
+			f = current_coroutine();
+			next_result<int> r = co_await it.next_until(std::chrono::steady_clock::now() + 10s);
+			co_return first == 0 && r.status == next_status::value ? *r.value : -1;
+		}(debounce(source(std::move(rx1), std::move(rx2), std::move(rx3), stage), 1ms), frame);
+
+		auto parked = [&frame]
+		{
+			for (auto until = std::chrono::steady_clock::now() + 5s; std::chrono::steady_clock::now() < until; std::this_thread::yield())
+				if (std::vector<async_frame> bt = async_backtrace(frame.load()); !bt.empty() && bt[0].parked) return true;
+			return false;
+		};
+		std::thread th([&consumer] { assert(consumer.wait() == 6); });
+		assert(parked());
+		tx1.set_value(1);
+		while (stage < 1) std::this_thread::yield();
+		assert(parked());
+		tx2.set_value(2);
+		while (stage < 2) std::this_thread::yield();
+		assert(parked());
+		tx3.set_value(3);
+		th.join();
+	}
+
+	{
+		// every version is a vector of equal elements, so a torn or reclaimed snapshot would be detected
+		static std::atomic<int> live{ 0 };
+		struct table
+		{
+			std::vector<int> entries;
+			explicit table(int v) : entries(64, v) { ++live; }
+			table(const table &other) : entries(other.entries) { ++live; }
+			~table() { --live; }
+		};
+
+		// the background reclaimer may still be destroying versions it took just before rcu_reclaim() ran
+		auto settled = [] { for (auto end = std::chrono::steady_clock::now() + std::chrono::seconds(1); live != 1 && std::chrono::steady_clock::now() < end; ) std::this_thread::yield(); return live == 1; };
+
+		rcu_cell<table> routes(std::in_place, 0);
+		const table *first = routes.read();
+		routes.publish(table{ 1 });
+		assert(routes.read()->entries[0] == 1 && first->entries[63] == 0); // the old version stays valid until this thread's quiescent point
+		assert(rcu_reclaim() == 1);
+		rcu_quiescent();
+		assert(rcu_reclaim() == 0 && settled());
+
+		thread_pool pool(4);
+		std::atomic<int> checked{ 0 };
+		for (int i = 0; i < 2000; ++i)
+		{
+			pool.schedule([](rcu_cell<table> &routes, std::atomic<int> &checked) -> lazy_task<>
+			{
+				for (int j = 0; j < 20; ++j)
+				{
+					const table *t = routes.read();
+					assert(std::all_of(t->entries.begin(), t->entries.end(), [&](int v) { return v == t->entries[0]; }));
+				}
+				++checked;
+				co_return;
+			}(routes, checked));
+			if (i % 20 == 0) routes.update([](table &t) { for (int &v : t.entries) ++v; });
+		}
+		pool.wait();
+		assert(checked == 2000 && routes.read()->entries[0] == 101);
+
+		// the pool's threads passed quiescent points after their last resume
+		rcu_quiescent();
+		assert(rcu_reclaim() == 0 && settled());
+
+		// short-lived readers exit (some of them still online) while versions are replaced and reclaimed
+		std::atomic<bool> stop{ false };
+		std::thread writer([&routes, &stop] { while (!stop) { routes.update([](table &t) { for (int &v : t.entries) ++v; }); rcu_reclaim(); } });
+		auto uniform = [](const table *t) { return std::all_of(t->entries.begin(), t->entries.end(), [&](int v) { return v == t->entries[0]; }); };
+		for (int batch = 0; batch < 25; ++batch)
+		{
+			std::vector<std::thread> readers;
+			for (int i = 0; i < 8; ++i)
+			{
+				readers.emplace_back([&routes, &uniform, i]
+				{
+					if (i % 2) assert([](rcu_cell<table> &routes, decltype(uniform) &uniform) -> task<bool> { co_return uniform(routes.read()); }(routes, uniform).wait());
+					else assert(uniform(routes.read()));
+					if (i % 4 == 0) rcu_quiescent();
+				});
+			}
+			for (std::thread &t : readers) t.join();
+		}
+		stop = true;
+		writer.join();
+		rcu_quiescent();
+		assert(rcu_reclaim() == 0 && settled());
+	}
+
+	{
+		thread_pool pool(4);
+
+		// a budget of 1 byte admits a spawn only once every earlier frame of the group is gone - so tasks run one at a time
+		frame_budget budget(1);
+		std::atomic<int> running{ 0 }, peak{ 0 }, finished{ 0 };
+		lazy_task<> spawner = [](frame_budget &budget, thread_pool &pool, std::atomic<int> &running, std::atomic<int> &peak, std::atomic<int> &finished) -> lazy_task<>
+		{
+			for (int i = 0; i < 20; ++i)
+			{
+				co_await budget.spawn(pool, [&]
+				{
+					return [](frame_budget &budget, std::atomic<int> &running, std::atomic<int> &peak, std::atomic<int> &finished) -> lazy_task<>
+					{
+						int now = ++running;
+						for (int p = peak; now > p && !peak.compare_exchange_weak(p, now); );
+
+						// frames created by a budgeted coroutine are charged to its budget
+						std::size_t own = budget.live();
+						assert(own > 0);
+						co_await [](frame_budget &budget, std::size_t own) -> lazy_task<> { assert(budget.live() > own); co_return; }(budget, own);
+
+						co_await sleep_for(std::chrono::milliseconds(1));
+						--running;
+						++finished;
+					}(budget, running, peak, finished);
+				});
+			}
+		}(budget, pool, running, peak, finished);
+		spawner.wait();
+		pool.wait();
+		assert(finished == 20 && peak == 1 && budget.live() == 0);
+
+		// a roomy budget admits right away, and a throwing factory schedules nothing
+		frame_budget roomy(1 << 20);
+		[](frame_budget &budget, thread_pool &pool) -> task<>
+		{
+			for (int i = 0; i < 20; ++i) co_await budget.spawn(pool, [] { return []() -> lazy_task<> { co_await sleep_for(std::chrono::milliseconds(1)); }(); });
+		}(roomy, pool).wait();
+		pool.wait();
+		assert(roomy.live() == 0);
+		assert_throws([](frame_budget &budget, thread_pool &pool) -> task<> { co_await budget.spawn(pool, []() -> lazy_task<> { throw 9; }); }(roomy, pool).wait(), int);
+	}
+
+	{
+		incremental graph;
+		auto &a = graph.make_input(1);
+		auto &b = graph.make_input(10);
+		auto &enabled = graph.make_input(true);
+
+		int sum_runs = 0, parity_runs = 0, out_runs = 0;
+		auto &sum = graph.make_derived([&](incremental::context &ctx) -> lazy_task<int> { ++sum_runs; co_return ctx.get(a) + ctx.get(b); });
+		auto &parity = graph.make_derived([&](incremental::context &ctx) -> lazy_task<int> { ++parity_runs; co_return ctx.get(sum) % 2; });
+		auto &out = graph.make_derived([&](incremental::context &ctx) -> lazy_task<std::string>
+		{
+			++out_runs;
+			co_return ctx.get(enabled) ? "parity " + std::to_string(ctx.get(parity)) : std::string("off");
+		});
+
+		assert(graph.get(out) == "parity 1" && sum_runs == 1 && parity_runs == 1 && out_runs == 1);
+		assert(graph.get(out) == "parity 1" && sum_runs == 1);
+
+		// the parity is unchanged, so out is not re-run (early cutoff)
+		a.set(3);
+		assert(graph.get(out) == "parity 1" && sum_runs == 2 && parity_runs == 2 && out_runs == 1);
+
+		// setting an equal value does not start a revision
+		std::uint64_t rev = graph.current_revision();
+		b.set(10);
+		assert(graph.current_revision() == rev);
+
+		// dependencies are recorded per run - once disabled, out no longer depends on sum
+		enabled.set(false);
+		assert(graph.get(out) == "off" && out_runs == 2);
+		a.set(4);
+		assert(graph.get(out) == "off" && sum_runs == 2 && out_runs == 2);
+		enabled.set(true);
+		assert(graph.get(out) == "parity 0" && sum_runs == 3 && out_runs == 3);
+
+		// a wide graph - after a change, only the affected squares are re-run (in parallel) and then the total
+		thread_pool pool(4);
+		incremental wide;
+		std::vector<incremental::input<int>*> xs;
+		std::vector<incremental::derived<long long>*> squares;
+		std::atomic<int> square_runs{ 0 };
+		for (int i = 0; i < 64; ++i)
+		{
+			auto &x = wide.make_input(i);
+			xs.push_back(&x);
+			squares.push_back(&wide.make_derived([&x, &square_runs](incremental::context &ctx) -> lazy_task<long long> { ++square_runs; long long v = ctx.get(x); co_return v * v; }));
+		}
+		auto &total = wide.make_derived([&](incremental::context &ctx) -> lazy_task<long long>
+		{
+			long long t = 0;
+			for (auto *s : squares) t += ctx.get(*s);
+			if (t < 0) throw std::invalid_argument("negative total");
+			co_return t;
+		});
+
+		auto eval = [](incremental &g, thread_pool &pool, incremental::derived<long long> &n) -> task<long long> { co_return co_await g.evaluate(pool, n); };
+		assert(eval(wide, pool, total).wait() == 85344 && square_runs == 64);
+		xs[3]->set(-3);
+		xs[5]->set(6);
+		xs[60]->set(0);
+		assert(eval(wide, pool, total).wait() == 85344 + 36 - 25 - 3600 && square_runs == 67);
+		assert(eval(wide, pool, total).wait() == 81755 && square_runs == 67);
+
+		// a failed computation is retried by the next evaluation
+		auto &failing = wide.make_derived([&](incremental::context &ctx) -> lazy_task<long long> { if (ctx.get(*xs[0]) < 0) throw std::invalid_argument("negative"); co_return ctx.get(total); });
+		xs[0]->set(-1);
+		assert_throws(eval(wide, pool, failing).wait(), std::invalid_argument);
+		xs[0]->set(0);
+		assert(eval(wide, pool, failing).wait() == 81755);
+	}
+
+	{
+		// a re-run which parks does not hold up the pool worker which started it
+		thread_pool pool(1);
+		incremental graph;
+		auto &seed = graph.make_input(1);
+		std::optional<oneshot<int>::receiver> extra;
+		std::atomic<int> fast_runs{ 0 };
+		auto &slow = graph.make_derived([&](incremental::context &ctx) -> lazy_task<int> { int s = ctx.get(seed); co_return s + co_await *extra; });
+		auto &fast = graph.make_derived([&](incremental::context &ctx) -> lazy_task<int> { ++fast_runs; co_return ctx.get(seed) * 10; });
+		auto &both = graph.make_derived([&](incremental::context &ctx) -> lazy_task<int> { co_return ctx.get(slow) + ctx.get(fast); });
+		auto eval = [](incremental &g, thread_pool &pool, incremental::derived<int> &n) -> task<int> { co_return co_await g.evaluate(pool, n); };
+
+		auto [tx1, rx1] = oneshot<int>::make();
+		extra.emplace(std::move(rx1));
+		tx1.set_value(100);
+		assert(eval(graph, pool, both).wait() == 111);
+
+		auto [tx2, rx2] = oneshot<int>::make();
+		extra.emplace(std::move(rx2));
+		seed.set(2);
+		auto pending = eval(graph, pool, both);
+		while (fast_runs != 2) std::this_thread::yield(); // slow and fast are on the same level - fast runs even while slow is parked
+		tx2.set_value(200);
+		assert(pending.wait() == 202 + 20);
+	}
+
+	{
+		thread_pool pool(4);
+		std::atomic<int> count{ 0 };
+		{
+			std::int64_t frames = metrics::read(metrics::metric::frames_allocated);
+			worker_group<> group(pool);
+			for (int i = 0; i < 10000; ++i) group.submit([&count] { ++count; });
+			group.close();
+			assert(count == 10000);
+			assert(metrics::read(metrics::metric::frames_allocated) - frames == 4); // just the workers
+			assert_throws(group.submit([] {}), std::invalid_argument);
+		}
+
+		// jobs which suspend park their worker, freeing the (single) thread for the other workers
+		thread_pool single(1);
+		std::vector<oneshot<int>::sender> senders;
+		std::vector<oneshot<int>::receiver> receivers;
+		for (int i = 0; i < 4; ++i) { auto [s, r] = oneshot<int>::make(); senders.push_back(std::move(s)); receivers.push_back(std::move(r)); }
+		{
+			struct job
+			{
+				oneshot<int>::receiver *r;
+				std::atomic<int>       *started;
+				oneshot<int>::receiver operator()() const { ++*started; return std::move(*r); }
+			};
+			std::atomic<int> started{ 0 };
+			worker_group<job> group(single, 4);
+			for (auto &r : receivers) group.submit({ &r, &started });
+			for (auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5); started < 4 && std::chrono::steady_clock::now() < end; ) std::this_thread::yield();
+			assert(started == 4);
+			for (auto &s : senders) s.set_value(1);
+			group.close();
+		}
+
+		// the first exception thrown by a job is rethrown by close()
+		worker_group<> failing(pool, 2);
+		failing.submit([] { throw 5; });
+		failing.submit([&count] { ++count; });
+		assert_throws(failing.close(), int);
+		assert(count == 10001);
+	}
+
+	{
+		// two coroutines taking two mutexes in opposite order
+		async_mutex m1, m2;
+		auto locker = [](async_mutex &first, async_mutex &second) -> lazy_task<>
+		{
+			co_await first.lock();
+			co_await std::experimental::suspend_always{};
+			co_await second.lock();
+			second.unlock();
+			first.unlock();
+		};
+		lazy_task<> a = locker(m1, m2), b = locker(m2, m1);
+		a.resume();
+		b.resume();
+		a.resume(); // queued on m2, held by b
+		assert(find_deadlocks().empty());
+
+		std::mutex report_mutex;
+		std::vector<deadlock_cycle> reports;
+		std::atomic<int> report_count{ 0 };
+		std::optional<deadlock_detector> detector;
+		detector.emplace([&](const std::vector<deadlock_cycle> &cycles)
+		{
+			std::lock_guard<std::mutex> lock(report_mutex);
+			reports.insert(reports.end(), cycles.begin(), cycles.end());
+			++report_count;
+		}, std::chrono::milliseconds(2));
+		assert_throws(deadlock_detector(nullptr), std::invalid_argument);
+
+		b.resume(); // queued on m1, held by a
+		std::vector<deadlock_cycle> cycles = find_deadlocks();
+		assert(cycles.size() == 1 && cycles[0].size() == 2);
+		for (const deadlock_link &link : cycles[0])
+		{
+			assert(std::strcmp(link.kind, "async_mutex") == 0 && (link.resource == &m1 || link.resource == &m2));
+			assert(!link.backtrace.empty() && link.backtrace[0].parked);
+		}
+		assert(cycles[0][0].resource != cycles[0][1].resource);
+
+		std::ostringstream text;
+		write_deadlocks(text, cycles);
+		assert(text.str().find("deadlock between 2 coroutines") != std::string::npos && text.str().find("async_mutex") != std::string::npos);
+
+		for (auto start = std::chrono::steady_clock::now(); report_count == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5);) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(20)); // a persisting deadlock is only reported once
+		detector.reset();
+		assert(report_count == 1 && reports.size() == 1 && reports[0].size() == 2);
+
+		// releasing m1 on a's behalf hands it to b, which breaks the cycle
+		m1.unlock();
+		assert(find_deadlocks().empty());
+		wait_all(a, b);
+		assert(m1.try_lock() && m2.try_lock());
+		m1.unlock();
+		m2.unlock();
+	}
+	{
+		// a coroutine awaiting a task which needs the mutex it holds
+		async_mutex m;
+		lazy_task<> outer = [](async_mutex &m) -> lazy_task<>
+		{
+			co_await m.lock();
+			co_await [](async_mutex &m) -> lazy_task<> { co_await m.lock(); m.unlock(); }(m);
+		}(m);
+		std::thread th([&outer] { outer.wait(); });
+
+		std::vector<deadlock_cycle> cycles;
+		for (auto start = std::chrono::steady_clock::now(); cycles.empty() && std::chrono::steady_clock::now() - start < std::chrono::seconds(5);) cycles = find_deadlocks();
+		assert(cycles.size() == 1 && cycles[0].size() == 2);
+		assert((cycles[0][0].resource == nullptr) != (cycles[0][1].resource == nullptr));
+
+		m.unlock();
+		th.join();
+		assert(find_deadlocks().empty() && m.try_lock());
+		m.unlock();
+	}
+	{
+		// once next_until() times out, the consumer no longer awaits the generator - even though the generator is now queued on a mutex the consumer holds
+		async_mutex m;
+		lazy_task<int> consumer = [](async_mutex &m) -> lazy_task<int>
+		{
+			co_await m.lock();
+			auto gen = [](async_mutex &m) -> generator<int> { co_yield 0; co_await m.lock(); m.unlock(); co_yield 1; }(m);
+			auto it = gen.begin();
+			bool timed_out = (co_await it.next_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(10))).status == next_status::timeout;
+			bool clear = find_deadlocks().empty();
+			m.unlock(); // hands the mutex to the generator
+			next_result<int> r = co_await it.next_until(std::chrono::steady_clock::time_point::max());
+			co_return timed_out && clear && r ? *r.value : -1;
+		}(m);
+		assert(consumer.wait() == 1);
+	}
+
 	std::cout << "all tests completed\n";
 
 	return 0;